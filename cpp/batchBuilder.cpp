@@ -0,0 +1,284 @@
+#include "batchBuilder.h"
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+// Extra header tags are written under their own name as strings, except for the
+// dates and times, the rating diffs and Site, which is reduced to the game id.
+static std::shared_ptr<arrow::Field> tagField(const std::string& tag) {
+    if (tag == "Site") {
+        return arrow::field("gameId", arrow::utf8());
+    } else if (tag == "UTCDate" || tag == "Date" || tag == "EventDate") {
+        return arrow::field(tag, arrow::date32());
+    } else if (tag == "UTCTime" || tag == "Time") {
+        return arrow::field(tag, arrow::time32(arrow::TimeUnit::MILLI));
+    } else if (tag == "WhiteRatingDiff" || tag == "BlackRatingDiff") {
+        return arrow::field(tag, arrow::int16());
+    }
+    return arrow::field(tag, arrow::utf8());
+}
+
+static bool parseNumber(std::string_view str, int& val) {
+    if (!str.empty() && str[0] == '+') str.remove_prefix(1);
+    auto res = std::from_chars(str.data(), str.data() + str.size(), val);
+    return !str.empty() && res.ec == std::errc() && res.ptr == str.data() + str.size();
+}
+
+// splits "2024.01.31" or "12:34:56" into its three numbers
+static bool parseTriple(std::string_view str, char sep, int& a, int& b, int& c) {
+    size_t i = str.find(sep);
+    size_t j = str.find(sep, i + 1);
+    return i != std::string_view::npos && j != std::string_view::npos
+        && parseNumber(str.substr(0, i), a)
+        && parseNumber(str.substr(i + 1, j - i - 1), b)
+        && parseNumber(str.substr(j + 1), c);
+}
+
+static arrow::Status appendTag(arrow::ArrayBuilder* builder, std::string_view value) {
+    // a missing tag or an unknown date ("????.??.??") is null
+    int a, b, c;
+    switch (builder->type()->id()) {
+        case arrow::Type::DATE32: {
+            if (!parseTriple(value, '.', a, b, c)) return builder->AppendNull();
+            std::chrono::year_month_day ymd{std::chrono::year(a), std::chrono::month(b), std::chrono::day(c)};
+            if (!ymd.ok()) return builder->AppendNull();
+            return static_cast<arrow::Date32Builder*>(builder)->Append(std::chrono::sys_days(ymd).time_since_epoch().count());
+        }
+        case arrow::Type::TIME32:
+            if (!parseTriple(value, ':', a, b, c)) return builder->AppendNull();
+            return static_cast<arrow::Time32Builder*>(builder)->Append((a * 3600 + b * 60 + c) * 1000);
+        case arrow::Type::INT16:
+            if (!parseNumber(value, a)) return builder->AppendNull();
+            return static_cast<arrow::Int16Builder*>(builder)->Append(a);
+        default:
+            if (value.empty()) return builder->AppendNull();
+            return static_cast<arrow::StringBuilder*>(builder)->Append(value);
+    }
+}
+
+std::shared_ptr<arrow::Schema> BatchBuilder::makeSchema(int move_output, bool numeric_annotations, const std::vector<std::string>& extra_tags) {
+    arrow::FieldVector fields;
+    if (move_output & MOVES_SAN) {
+        fields.push_back(arrow::field("moves", arrow::utf8()));
+    }
+    if (move_output & MOVES_CODES) {
+        fields.push_back(arrow::field("move_codes", arrow::list(arrow::uint16())));
+    }
+    if (move_output & MOVES_UCI) {
+        fields.push_back(arrow::field("uci", arrow::utf8()));
+    }
+    if (move_output & MOVES_HASHES) {
+        fields.push_back(arrow::field("hashes", arrow::list(arrow::uint64())));
+    }
+    if (numeric_annotations) {
+        fields.push_back(arrow::field("clk", arrow::list(arrow::int32())));
+        fields.push_back(arrow::field("eval", arrow::list(arrow::float32())));
+        fields.push_back(arrow::field("mate", arrow::list(arrow::int16())));
+    } else {
+        fields.push_back(arrow::field("clk", arrow::utf8()));
+        fields.push_back(arrow::field("eval", arrow::utf8()));
+    }
+    for (auto field: {arrow::field("result", arrow::int8()),
+            arrow::field("welo", arrow::int16()),
+            arrow::field("belo", arrow::int16()),
+            arrow::field("white", arrow::utf8()),
+            arrow::field("black", arrow::utf8()),
+            arrow::field("timeCtl", arrow::int16()), 
+            arrow::field("increment", arrow::int16())}) {
+        fields.push_back(field);
+    }
+    for (auto& tag: extra_tags) {
+        fields.push_back(tagField(tag));
+    }
+    return arrow::schema(fields);
+}
+
+BatchBuilder::BatchBuilder(int move_output, bool numeric_annotations, std::vector<std::string> extra_tags)
+    : move_output(move_output), numeric_annotations(numeric_annotations), extra_tags(extra_tags),
+    schema(makeSchema(move_output, numeric_annotations, extra_tags)), n_rows(0), n_bytes(0) {
+    auto pool = arrow::default_memory_pool();
+    mv_builder = arrow::StringBuilder(pool);
+    uci_builder = arrow::StringBuilder(pool);
+    code_value_builder = std::make_shared<arrow::UInt16Builder>(pool);
+    code_builder = std::make_shared<arrow::ListBuilder>(pool, code_value_builder);
+    hash_value_builder = std::make_shared<arrow::UInt64Builder>(pool);
+    hash_builder = std::make_shared<arrow::ListBuilder>(pool, hash_value_builder);
+    clk_builder = arrow::StringBuilder(pool);
+    eval_builder = arrow::StringBuilder(pool);
+    clk_value_builder = std::make_shared<arrow::Int32Builder>(pool);
+    clk_list_builder = std::make_shared<arrow::ListBuilder>(pool, clk_value_builder);
+    eval_value_builder = std::make_shared<arrow::FloatBuilder>(pool);
+    eval_list_builder = std::make_shared<arrow::ListBuilder>(pool, eval_value_builder);
+    mate_value_builder = std::make_shared<arrow::Int16Builder>(pool);
+    mate_list_builder = std::make_shared<arrow::ListBuilder>(pool, mate_value_builder);
+    welo_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);
+    belo_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);
+    white_builder = arrow::StringBuilder(pool);
+    black_builder = arrow::StringBuilder(pool);
+    timeCtl_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);
+    increment_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);
+    result_builder = arrow::NumericBuilder<arrow::Int8Type>(pool);
+    for (size_t i = schema->num_fields() - extra_tags.size(); i < static_cast<size_t>(schema->num_fields()); i++) {
+        std::unique_ptr<arrow::ArrayBuilder> builder;
+        auto status = arrow::MakeBuilder(pool, schema->field(i)->type(), &builder);
+        if (!status.ok()) {
+            throw std::runtime_error("Error creating builder: " + status.ToString());
+        }
+        tag_builders.push_back(std::move(builder));
+    }
+}
+
+arrow::Status BatchBuilder::append(PgnProcessor& processor, const ParsedMoves& parsed, const std::vector<uint16_t>& codes, std::string_view uci, const std::vector<uint64_t>& hashes) {
+    if (move_output & MOVES_SAN) {
+        ARROW_RETURN_NOT_OK(mv_builder.Append(parsed.mvs));
+    }
+    if (move_output & MOVES_CODES) {
+        ARROW_RETURN_NOT_OK(code_builder->Append());
+        ARROW_RETURN_NOT_OK(code_value_builder->AppendValues(codes));
+    }
+    if (move_output & MOVES_UCI) {
+        ARROW_RETURN_NOT_OK(uci_builder.Append(uci));
+    }
+    if (move_output & MOVES_HASHES) {
+        ARROW_RETURN_NOT_OK(hash_builder->Append());
+        ARROW_RETURN_NOT_OK(hash_value_builder->AppendValues(hashes));
+    }
+    if (numeric_annotations) {
+        ARROW_RETURN_NOT_OK(clk_list_builder->Append());
+        ARROW_RETURN_NOT_OK(clk_value_builder->AppendValues(parsed.clkSecs));
+        ARROW_RETURN_NOT_OK(eval_list_builder->Append());
+        ARROW_RETURN_NOT_OK(mate_list_builder->Append());
+        auto& evals = parsed.evals;
+        for (size_t k=0; k<evals.size(); k++) {
+            if (std::isnan(evals[k])) {
+                ARROW_RETURN_NOT_OK(eval_value_builder->AppendNull());
+                ARROW_RETURN_NOT_OK(mate_value_builder->Append(parsed.mates[k]));
+            } else {
+                ARROW_RETURN_NOT_OK(eval_value_builder->Append(evals[k]));
+                ARROW_RETURN_NOT_OK(mate_value_builder->AppendNull());
+            }
+        }
+    } else {
+        ARROW_RETURN_NOT_OK(clk_builder.Append(parsed.clk));
+        ARROW_RETURN_NOT_OK(eval_builder.Append(parsed.eval));
+    }
+    ARROW_RETURN_NOT_OK(welo_builder.Append(processor.getWelo()));
+    ARROW_RETURN_NOT_OK(belo_builder.Append(processor.getBelo()));
+    ARROW_RETURN_NOT_OK(white_builder.Append(processor.getWhite()));
+    ARROW_RETURN_NOT_OK(black_builder.Append(processor.getBlack()));
+    ARROW_RETURN_NOT_OK(timeCtl_builder.Append(processor.getTime()));
+    ARROW_RETURN_NOT_OK(increment_builder.Append(processor.getInc()));
+    ARROW_RETURN_NOT_OK(result_builder.Append(parsed.result));
+    for (size_t k = 0; k < tag_builders.size(); k++) {
+        std::string_view value = processor.getTag(k);
+        if (extra_tags[k] == "Site") {
+            value = value.substr(value.rfind('/') + 1);
+        }
+        ARROW_RETURN_NOT_OK(appendTag(tag_builders[k].get(), value));
+    }
+    n_rows++;
+    n_bytes += rowBytes(processor, parsed, codes, uci, hashes);
+    return arrow::Status::OK();
+}
+
+// the column data of a row, with an offset per string or list and the fixed width
+// columns; bitmaps are left out
+size_t BatchBuilder::rowBytes(PgnProcessor& processor, const ParsedMoves& parsed, const std::vector<uint16_t>& codes, std::string_view uci, const std::vector<uint64_t>& hashes) const {
+    size_t bytes = 2 * 4 + processor.getWhite().size() + processor.getBlack().size() + 4 * 2 + 1;
+    if (move_output & MOVES_SAN) {
+        bytes += 4 + parsed.mvs.size();
+    }
+    if (move_output & MOVES_CODES) {
+        bytes += 4 + sizeof(uint16_t) * codes.size();
+    }
+    if (move_output & MOVES_UCI) {
+        bytes += 4 + uci.size();
+    }
+    if (move_output & MOVES_HASHES) {
+        bytes += 4 + sizeof(uint64_t) * hashes.size();
+    }
+    if (numeric_annotations) {
+        bytes += 3 * 4 + sizeof(int32_t) * parsed.clkSecs.size() + (sizeof(float) + sizeof(int16_t)) * parsed.evals.size();
+    } else {
+        bytes += 2 * 4 + parsed.clk.size() + parsed.eval.size();
+    }
+    for (size_t k = 0; k < tag_builders.size(); k++) {
+        bytes += 4 + processor.getTag(k).size();
+    }
+    return bytes;
+}
+
+int64_t BatchBuilder::size() const {
+    return n_rows;
+}
+
+size_t BatchBuilder::bytes() const {
+    return n_bytes;
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> BatchBuilder::finish() {
+    std::shared_ptr<arrow::Array> moves;
+    std::shared_ptr<arrow::Array> codes;
+    std::shared_ptr<arrow::Array> uci;
+    std::shared_ptr<arrow::Array> hashes;
+    std::shared_ptr<arrow::Array> clk;
+    std::shared_ptr<arrow::Array> welos;
+    std::shared_ptr<arrow::Array> belos;
+    std::shared_ptr<arrow::Array> white;
+    std::shared_ptr<arrow::Array> black;
+    std::shared_ptr<arrow::Array> timeCtl;
+    std::shared_ptr<arrow::Array> increment;
+    std::shared_ptr<arrow::Array> result;
+    std::shared_ptr<arrow::Array> eval;
+    std::shared_ptr<arrow::Array> mate;
+
+    // Finish also resets the builders for the next batch
+    arrow::ArrayVector columns;
+    if (move_output & MOVES_SAN) {
+        ARROW_RETURN_NOT_OK(mv_builder.Finish(&moves));
+        columns.push_back(moves);
+    }
+    if (move_output & MOVES_CODES) {
+        ARROW_RETURN_NOT_OK(code_builder->Finish(&codes));
+        columns.push_back(codes);
+    }
+    if (move_output & MOVES_UCI) {
+        ARROW_RETURN_NOT_OK(uci_builder.Finish(&uci));
+        columns.push_back(uci);
+    }
+    if (move_output & MOVES_HASHES) {
+        ARROW_RETURN_NOT_OK(hash_builder->Finish(&hashes));
+        columns.push_back(hashes);
+    }
+    if (numeric_annotations) {
+        ARROW_RETURN_NOT_OK(clk_list_builder->Finish(&clk));
+        ARROW_RETURN_NOT_OK(eval_list_builder->Finish(&eval));
+        ARROW_RETURN_NOT_OK(mate_list_builder->Finish(&mate));
+        columns.insert(columns.end(), {clk, eval, mate});
+    } else {
+        ARROW_RETURN_NOT_OK(clk_builder.Finish(&clk));
+        ARROW_RETURN_NOT_OK(eval_builder.Finish(&eval));
+        columns.insert(columns.end(), {clk, eval});
+    }
+    ARROW_RETURN_NOT_OK(welo_builder.Finish(&welos));
+    ARROW_RETURN_NOT_OK(belo_builder.Finish(&belos));
+    ARROW_RETURN_NOT_OK(white_builder.Finish(&white));
+    ARROW_RETURN_NOT_OK(black_builder.Finish(&black));
+    ARROW_RETURN_NOT_OK(timeCtl_builder.Finish(&timeCtl));
+    ARROW_RETURN_NOT_OK(increment_builder.Finish(&increment));
+    ARROW_RETURN_NOT_OK(result_builder.Finish(&result));
+
+    for (auto column: {result, welos, belos, white, black, timeCtl, increment}) {
+        columns.push_back(column);
+    }
+    for (auto& builder: tag_builders) {
+        std::shared_ptr<arrow::Array> column;
+        ARROW_RETURN_NOT_OK(builder->Finish(&column));
+        columns.push_back(column);
+    }
+    auto batch = arrow::RecordBatch::Make(schema, n_rows, columns);
+    n_rows = 0;
+    n_bytes = 0;
+    return batch;
+}
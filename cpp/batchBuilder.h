@@ -0,0 +1,58 @@
+#ifndef BATCH_BUILDER_H
+#define BATCH_BUILDER_H
+#include <arrow/api.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "parseMoves.h"
+#include "parser.h"
+
+// Builds the Arrow columns of the Parquet files a game at a time. Block tasks each
+// append to their own builder, so the movetext goes from the parser's buffers
+// straight into Arrow buffers, and the writer only receives finished batches.
+class BatchBuilder {
+public:
+    BatchBuilder(int move_output, bool numeric_annotations, std::vector<std::string> extra_tags);
+    static std::shared_ptr<arrow::Schema> makeSchema(int move_output, bool numeric_annotations, const std::vector<std::string>& extra_tags);
+    // the header fields and extra tags come from processor, which holds a complete
+    // game; codes, uci and hashes are only read if they are written
+    arrow::Status append(PgnProcessor& processor, const ParsedMoves& parsed, const std::vector<uint16_t>& codes, std::string_view uci, const std::vector<uint64_t>& hashes);
+    int64_t size() const;
+    // an estimate of the memory the rows appended since the last finish take
+    size_t bytes() const;
+    // the rows appended since the last finish
+    arrow::Result<std::shared_ptr<arrow::RecordBatch>> finish();
+private:
+    size_t rowBytes(PgnProcessor& processor, const ParsedMoves& parsed, const std::vector<uint16_t>& codes, std::string_view uci, const std::vector<uint64_t>& hashes) const;
+    int move_output;
+    bool numeric_annotations;
+    std::vector<std::string> extra_tags;
+    std::shared_ptr<arrow::Schema> schema;
+    int64_t n_rows;
+    size_t n_bytes;
+    arrow::StringBuilder mv_builder;
+    arrow::StringBuilder uci_builder;
+    std::shared_ptr<arrow::UInt16Builder> code_value_builder;
+    std::shared_ptr<arrow::ListBuilder> code_builder;
+    std::shared_ptr<arrow::UInt64Builder> hash_value_builder;
+    std::shared_ptr<arrow::ListBuilder> hash_builder;
+    arrow::StringBuilder clk_builder;
+    arrow::StringBuilder eval_builder;
+    std::shared_ptr<arrow::Int32Builder> clk_value_builder;
+    std::shared_ptr<arrow::ListBuilder> clk_list_builder;
+    std::shared_ptr<arrow::FloatBuilder> eval_value_builder;
+    std::shared_ptr<arrow::ListBuilder> eval_list_builder;
+    std::shared_ptr<arrow::Int16Builder> mate_value_builder;
+    std::shared_ptr<arrow::ListBuilder> mate_list_builder;
+    arrow::StringBuilder white_builder;
+    arrow::StringBuilder black_builder;
+    arrow::NumericBuilder<arrow::Int16Type> welo_builder;
+    arrow::NumericBuilder<arrow::Int16Type> belo_builder;
+    arrow::NumericBuilder<arrow::Int16Type> timeCtl_builder;
+    arrow::NumericBuilder<arrow::Int16Type> increment_builder;
+    arrow::NumericBuilder<arrow::Int8Type> result_builder;
+    std::vector<std::unique_ptr<arrow::ArrayBuilder>> tag_builders;
+};
+
+#endif
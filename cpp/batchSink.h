@@ -0,0 +1,28 @@
+#ifndef BATCH_SINK_H
+#define BATCH_SINK_H
+#include <arrow/api.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// rows for one partition
+struct PartitionRows {
+    size_t partition;
+    std::shared_ptr<arrow::RecordBatch> rows;
+};
+
+// Where parse tasks hand their rows, split by partition.
+class BatchSink {
+public:
+    virtual ~BatchSink() {}
+    // Takes the rows, which hold only partitions that have rows, each at most once.
+    // Returns false if the sink is full, in which case the caller should stop making
+    // rows until resume is called. Without resume the caller is never parked.
+    virtual bool queueBatch(const std::vector<PartitionRows>& rows, std::function<void()> resume) = 0;
+    // asks the sink to free memory early; never waits
+    virtual void requestFlush() = 0;
+    // called once, after the last queueBatch
+    virtual void close() = 0;
+};
+
+#endif
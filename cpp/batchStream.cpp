@@ -0,0 +1,93 @@
+#include "batchStream.h"
+#include <algorithm>
+#include <stdexcept>
+
+class BatchStream::Reader: public arrow::RecordBatchReader {
+public:
+    Reader(std::shared_ptr<BatchStream> stream): stream(stream) {}
+    ~Reader() override {
+        stream->abandon();
+    }
+    std::shared_ptr<arrow::Schema> schema() const override {
+        return stream->schema;
+    }
+    arrow::Status ReadNext(std::shared_ptr<arrow::RecordBatch>* batch) override {
+        return stream->pop(batch);
+    }
+private:
+    std::shared_ptr<BatchStream> stream;
+};
+
+BatchStream::BatchStream(std::shared_ptr<arrow::Schema> schema, size_t queue_size)
+    : schema(schema), queue_size(std::max<size_t>(1, queue_size)), closed(false), abandoned(false), taken(false) {}
+
+bool BatchStream::queueBatch(const std::vector<PartitionRows>& rows, std::function<void()> resume) {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (abandoned) {
+        return true;
+    }
+    for (auto& piece: rows) {
+        batches.push_back(piece.rows);
+    }
+    cv.notify_one();
+    if (!resume || batches.size() < queue_size) {
+        return true;
+    }
+    // parked under mtx, which pop takes to remove a batch, so no wakeup is lost
+    parked.push_back(std::move(resume));
+    return false;
+}
+
+void BatchStream::requestFlush() {}
+
+void BatchStream::close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    cv.notify_one();
+}
+
+void BatchStream::fail(std::string message) {
+    std::lock_guard<std::mutex> lock(mtx);
+    error = message;
+    closed = true;
+    cv.notify_one();
+}
+
+arrow::Status BatchStream::pop(std::shared_ptr<arrow::RecordBatch>* batch) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !batches.empty() || closed; });
+    if (batches.empty()) {
+        *batch = nullptr;
+        return error.empty() ? arrow::Status::OK() : arrow::Status::IOError(error);
+    }
+    *batch = std::move(batches.front());
+    batches.pop_front();
+    if (batches.size() < queue_size) {
+        resumeParked(lock);
+    }
+    return arrow::Status::OK();
+}
+
+// resumes the parked tasks outside of mtx, as they may queue again right away
+void BatchStream::resumeParked(std::unique_lock<std::mutex>& lock) {
+    std::vector<std::function<void()>> resumed;
+    resumed.swap(parked);
+    lock.unlock();
+    for (auto& resume: resumed) {
+        resume();
+    }
+}
+
+std::shared_ptr<arrow::RecordBatchReader> BatchStream::reader() {
+    if (taken.exchange(true)) {
+        throw std::runtime_error("The stream can only be read once");
+    }
+    return std::make_shared<Reader>(shared_from_this());
+}
+
+void BatchStream::abandon() {
+    std::unique_lock<std::mutex> lock(mtx);
+    abandoned = true;
+    batches.clear();
+    resumeParked(lock);
+}
@@ -0,0 +1,50 @@
+#ifndef BATCH_STREAM_H
+#define BATCH_STREAM_H
+#include "batchSink.h"
+#include <arrow/api.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Hands batches to a RecordBatchReader in the same process instead of writing them.
+// Once queue_size batches wait for the reader, parse tasks that queue more are parked
+// until the reader takes one, which in turn parks the readers of the files. If the
+// reader is released before the end of the stream, the remaining batches are dropped.
+class BatchStream: public BatchSink, public std::enable_shared_from_this<BatchStream> {
+public:
+    BatchStream(std::shared_ptr<arrow::Schema> schema, size_t queue_size);
+    bool queueBatch(const std::vector<PartitionRows>& rows, std::function<void()> resume) override;
+    // batches waiting here can only be freed by the reader
+    void requestFlush() override;
+    // ends the stream once the reader has read every batch
+    void close() override;
+    // ends the stream with an error instead
+    void fail(std::string message);
+    // the reader of the stream, which can only be taken once
+    std::shared_ptr<arrow::RecordBatchReader> reader();
+    // drops the batches that are queued from now on
+    void abandon();
+private:
+    class Reader;
+    std::shared_ptr<arrow::Schema> schema;
+    size_t queue_size;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<arrow::RecordBatch>> batches;
+    // tasks waiting for the queue to go below queue_size
+    std::vector<std::function<void()>> parked;
+    bool closed;
+    // why the stream ended early, if it did
+    std::string error;
+    bool abandoned;
+    std::atomic<bool> taken;
+    // blocks until a batch is queued; null at the end of the stream
+    arrow::Status pop(std::shared_ptr<arrow::RecordBatch>* batch);
+    void resumeParked(std::unique_lock<std::mutex>& lock);
+};
+
+#endif
@@ -0,0 +1,396 @@
+#include <cstdlib>
+#include "board.h"
+
+using namespace std;
+
+#define FILE_A 0x0101010101010101ULL
+#define RANK_1 0xFFULL
+
+static inline uint64_t bit(int sq) {
+	return 1ULL << sq;
+}
+
+static inline int lsb(uint64_t bb) {
+	return __builtin_ctzll(bb);
+}
+
+static inline int msb(uint64_t bb) {
+	return 63 - __builtin_clzll(bb);
+}
+
+// rays 0-3 point towards higher squares (N, E, NE, NW), 4-7 towards lower ones (S, W, SE, SW)
+static const int DIR_RANK[8] = {1, 0, 1, 1, -1, 0, -1, -1};
+static const int DIR_FILE[8] = {0, 1, 1, -1, 0, -1, 1, -1};
+
+struct AttackTables {
+	uint64_t knight[64];
+	uint64_t king[64];
+	// squares attacked by a pawn of the given color standing on the square
+	uint64_t pawn[2][64];
+	uint64_t rays[8][64];
+	uint8_t castleMask[64];
+
+	AttackTables() {
+		static const int KNIGHT_STEPS[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+		for (int sq=0; sq<64; sq++) {
+			int r = sq / 8;
+			int f = sq % 8;
+			knight[sq] = king[sq] = pawn[WHITE][sq] = pawn[BLACK][sq] = 0;
+			for (auto step: KNIGHT_STEPS) {
+				knight[sq] |= target(r + step[0], f + step[1]);
+			}
+			for (int dir=0; dir<8; dir++) {
+				king[sq] |= target(r + DIR_RANK[dir], f + DIR_FILE[dir]);
+				rays[dir][sq] = 0;
+				for (int i=1; i<8; i++) {
+					rays[dir][sq] |= target(r + i*DIR_RANK[dir], f + i*DIR_FILE[dir]);
+				}
+			}
+			pawn[WHITE][sq] = target(r+1, f-1) | target(r+1, f+1);
+			pawn[BLACK][sq] = target(r-1, f-1) | target(r-1, f+1);
+			castleMask[sq] = CASTLE_WK | CASTLE_WQ | CASTLE_BK | CASTLE_BQ;
+		}
+		castleMask[0] &= ~CASTLE_WQ;
+		castleMask[7] &= ~CASTLE_WK;
+		castleMask[4] &= ~(CASTLE_WK | CASTLE_WQ);
+		castleMask[56] &= ~CASTLE_BQ;
+		castleMask[63] &= ~CASTLE_BK;
+		castleMask[60] &= ~(CASTLE_BK | CASTLE_BQ);
+	}
+
+	static uint64_t target(int r, int f) {
+		return (r >= 0 && r < 8 && f >= 0 && f < 8) ? bit(r*8 + f) : 0;
+	}
+};
+
+static const AttackTables TABLES;
+
+// Fixed pseudo-random keys, so hashes are stable across runs and can be joined on.
+struct ZobristKeys {
+	uint64_t piece[2][6][64];
+	uint64_t castling[16];
+	uint64_t epFile[8];
+	uint64_t side;
+
+	ZobristKeys() {
+		uint64_t state = 0x9E3779B97F4A7C15ULL;
+		for (auto& color: piece) {
+			for (auto& type: color) {
+				for (auto& sq: type) sq = next(state);
+			}
+		}
+		for (auto& k: castling) k = next(state);
+		for (auto& k: epFile) k = next(state);
+		side = next(state);
+	}
+
+	// splitmix64
+	static uint64_t next(uint64_t& state) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+};
+
+static const ZobristKeys ZOBRIST;
+
+static inline uint64_t rayAttacks(int dir, int sq, uint64_t occ) {
+	uint64_t attacks = TABLES.rays[dir][sq];
+	uint64_t blockers = attacks & occ;
+	if (blockers) {
+		attacks ^= TABLES.rays[dir][dir < 4 ? lsb(blockers) : msb(blockers)];
+	}
+	return attacks;
+}
+
+static inline uint64_t rookAttacks(int sq, uint64_t occ) {
+	return rayAttacks(0, sq, occ) | rayAttacks(1, sq, occ) | rayAttacks(4, sq, occ) | rayAttacks(5, sq, occ);
+}
+
+static inline uint64_t bishopAttacks(int sq, uint64_t occ) {
+	return rayAttacks(2, sq, occ) | rayAttacks(3, sq, occ) | rayAttacks(6, sq, occ) | rayAttacks(7, sq, occ);
+}
+
+static inline Color opponent(Color color) {
+	return color == WHITE ? BLACK : WHITE;
+}
+
+static PieceType pieceFromChar(char c) {
+	switch (c) {
+		case 'N': return KNIGHT;
+		case 'B': return BISHOP;
+		case 'R': return ROOK;
+		case 'Q': return QUEEN;
+		case 'K': return KING;
+		default: return NO_PIECE;
+	}
+}
+
+Board::Board() {
+	reset();
+}
+
+void Board::reset() {
+	static const PieceType BACK_RANK[8] = {ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK};
+	byColor[WHITE] = byColor[BLACK] = 0;
+	for (int i=0; i<6; i++) byType[i] = 0;
+	for (int sq=0; sq<64; sq++) mailbox[sq] = NO_PIECE;
+	key = 0;
+	for (int f=0; f<8; f++) {
+		put(f, WHITE, BACK_RANK[f]);
+		put(8 + f, WHITE, PAWN);
+		put(48 + f, BLACK, PAWN);
+		put(56 + f, BLACK, BACK_RANK[f]);
+	}
+	sideToMove = WHITE;
+	castling = CASTLE_WK | CASTLE_WQ | CASTLE_BK | CASTLE_BQ;
+	epSquare = -1;
+	key ^= ZOBRIST.castling[castling];
+}
+
+PieceType Board::pieceAt(int sq) const {
+	return mailbox[sq];
+}
+
+Color Board::colorAt(int sq) const {
+	return (byColor[BLACK] & bit(sq)) ? BLACK : WHITE;
+}
+
+Color Board::getSideToMove() const {
+	return sideToMove;
+}
+
+uint8_t Board::getCastling() const {
+	return castling;
+}
+
+int Board::getEpSquare() const {
+	return epSquare;
+}
+
+uint64_t Board::pieces(Color color, PieceType type) const {
+	return byColor[color] & byType[type];
+}
+
+uint64_t Board::hash() const {
+	if (epSquare >= 0 && (TABLES.pawn[opponent(sideToMove)][epSquare] & pieces(sideToMove, PAWN))) {
+		return key ^ ZOBRIST.epFile[epSquare % 8];
+	}
+	return key;
+}
+
+void Board::put(int sq, Color color, PieceType type) {
+	byColor[color] |= bit(sq);
+	byType[type] |= bit(sq);
+	mailbox[sq] = type;
+	key ^= ZOBRIST.piece[color][type][sq];
+}
+
+void Board::remove(int sq) {
+	key ^= ZOBRIST.piece[colorAt(sq)][mailbox[sq]][sq];
+	byColor[WHITE] &= ~bit(sq);
+	byColor[BLACK] &= ~bit(sq);
+	byType[mailbox[sq]] &= ~bit(sq);
+	mailbox[sq] = NO_PIECE;
+}
+
+// plays a pseudo-legal move without any checks
+void Board::makeMove(int from, int to, int promo) {
+	Color us = sideToMove;
+	PieceType type = mailbox[from];
+	if (type == PAWN && to == epSquare) {
+		remove(us == WHITE ? to - 8 : to + 8);
+	}
+	if (mailbox[to] != NO_PIECE) {
+		remove(to);
+	}
+	remove(from);
+	put(to, us, promo ? (PieceType)promo : type);
+
+	if (type == KING && abs(to - from) == 2) {
+		int rookFrom = to > from ? from + 3 : from - 4;
+		int rookTo = to > from ? from + 1 : from - 1;
+		remove(rookFrom);
+		put(rookTo, us, ROOK);
+	}
+	epSquare = (type == PAWN && abs(to - from) == 16) ? (from + to) / 2 : -1;
+	key ^= ZOBRIST.castling[castling];
+	castling &= TABLES.castleMask[from] & TABLES.castleMask[to];
+	key ^= ZOBRIST.castling[castling] ^ ZOBRIST.side;
+	sideToMove = opponent(us);
+}
+
+bool Board::attacked(int sq, Color by, uint64_t occ) const {
+	return (TABLES.pawn[opponent(by)][sq] & pieces(by, PAWN)) ||
+		(TABLES.knight[sq] & pieces(by, KNIGHT)) ||
+		(TABLES.king[sq] & pieces(by, KING)) ||
+		(bishopAttacks(sq, occ) & byColor[by] & (byType[BISHOP] | byType[QUEEN])) ||
+		(rookAttacks(sq, occ) & byColor[by] & (byType[ROOK] | byType[QUEEN]));
+}
+
+bool Board::leavesKingSafe(int from, int to, int promo) const {
+	Board next = *this;
+	next.makeMove(from, to, promo);
+	uint64_t king = next.pieces(sideToMove, KING);
+	return king != 0 && !next.attacked(lsb(king), next.sideToMove, next.byColor[WHITE] | next.byColor[BLACK]);
+}
+
+bool Board::playCastle(bool kingside, uint16_t& move) {
+	Color us = sideToMove;
+	Color them = opponent(us);
+	int kingFrom = us == WHITE ? 4 : 60;
+	uint8_t right = kingside ? (us == WHITE ? CASTLE_WK : CASTLE_BK) : (us == WHITE ? CASTLE_WQ : CASTLE_BQ);
+	if (!(castling & right) || mailbox[kingFrom] != KING) {
+		return false;
+	}
+	int step = kingside ? 1 : -1;
+	int kingTo = kingFrom + 2*step;
+	uint64_t occ = byColor[WHITE] | byColor[BLACK];
+	uint64_t between = kingside ? bit(kingFrom+1) | bit(kingFrom+2) : bit(kingFrom-1) | bit(kingFrom-2) | bit(kingFrom-3);
+	if ((occ & between) ||
+			attacked(kingFrom, them, occ) ||
+			attacked(kingFrom + step, them, occ) ||
+			attacked(kingTo, them, occ)) {
+		return false;
+	}
+	makeMove(kingFrom, kingTo, 0);
+	move = encodeMove(kingFrom, kingTo, 0);
+	return true;
+}
+
+bool Board::playSan(string_view san, uint16_t& move) {
+	while (!san.empty() && (san.back() == '+' || san.back() == '#')) {
+		san.remove_suffix(1);
+	}
+	if (san == "O-O" || san == "0-0") return playCastle(true, move);
+	if (san == "O-O-O" || san == "0-0-0") return playCastle(false, move);
+
+	PieceType type = pieceFromChar(san.empty() ? ' ' : san[0]);
+	size_t start = 1;
+	if (type == NO_PIECE) {
+		type = PAWN;
+		start = 0;
+	}
+	// "e8=Q" or "e8Q"
+	int promo = 0;
+	if (!san.empty() && pieceFromChar(san.back()) != NO_PIECE && pieceFromChar(san.back()) != KING) {
+		promo = pieceFromChar(san.back());
+		san.remove_suffix(1);
+		if (!san.empty() && san.back() == '=') san.remove_suffix(1);
+	}
+	if (san.size() < start + 2) return false;
+	char toFile = san[san.size()-2];
+	char toRank = san[san.size()-1];
+	if (toFile < 'a' || toFile > 'h' || toRank < '1' || toRank > '8') return false;
+	int to = (toRank - '1')*8 + (toFile - 'a');
+
+	uint64_t fromMask = ~0ULL;
+	bool capture = false;
+	for (size_t i=start; i<san.size()-2; i++) {
+		char c = san[i];
+		if (c >= 'a' && c <= 'h') {
+			fromMask &= FILE_A << (c - 'a');
+		} else if (c >= '1' && c <= '8') {
+			fromMask &= RANK_1 << 8*(c - '1');
+		} else if (c == 'x') {
+			capture = true;
+		} else {
+			return false;
+		}
+	}
+
+	Color us = sideToMove;
+	Color them = opponent(us);
+	uint64_t occ = byColor[WHITE] | byColor[BLACK];
+	if (byColor[us] & bit(to)) return false;
+	bool takes = (byColor[them] & bit(to)) || (type == PAWN && to == epSquare);
+	if (capture != takes) return false;
+
+	uint64_t candidates = 0;
+	switch (type) {
+		case PAWN: {
+			bool lastRank = us == WHITE ? to >= 56 : to < 8;
+			if (lastRank != (promo != 0)) return false;
+			if (capture) {
+				// pawn captures always name the file they come from
+				if (fromMask == ~0ULL) return false;
+				candidates = TABLES.pawn[them][to] & pieces(us, PAWN);
+			} else {
+				// nothing can push onto its own back rank, and there's no square behind it
+				if (to / 8 == (us == WHITE ? 0 : 7)) return false;
+				int back = us == WHITE ? -8 : 8;
+				int doubleRank = us == WHITE ? 3 : 4;
+				if (pieces(us, PAWN) & bit(to + back)) {
+					candidates = bit(to + back);
+				} else if (to / 8 == doubleRank && !(occ & bit(to + back)) && (pieces(us, PAWN) & bit(to + 2*back))) {
+					candidates = bit(to + 2*back);
+				}
+			}
+			break;
+		}
+		case KNIGHT:
+			candidates = TABLES.knight[to] & pieces(us, KNIGHT);
+			break;
+		case BISHOP:
+			candidates = bishopAttacks(to, occ) & pieces(us, BISHOP);
+			break;
+		case ROOK:
+			candidates = rookAttacks(to, occ) & pieces(us, ROOK);
+			break;
+		case QUEEN:
+			candidates = (bishopAttacks(to, occ) | rookAttacks(to, occ)) & pieces(us, QUEEN);
+			break;
+		case KING:
+			candidates = TABLES.king[to] & pieces(us, KING);
+			break;
+		default:
+			return false;
+	}
+	if (promo != 0 && type != PAWN) return false;
+
+	int from = -1;
+	for (candidates &= fromMask; candidates; candidates &= candidates - 1) {
+		int sq = lsb(candidates);
+		if (leavesKingSafe(sq, to, promo)) {
+			// more than one legal origin and not enough disambiguation
+			if (from >= 0) return false;
+			from = sq;
+		}
+	}
+	if (from < 0) return false;
+	makeMove(from, to, promo);
+	move = encodeMove(from, to, promo);
+	return true;
+}
+
+void appendUci(string& dst, uint16_t move) {
+	static const char PROMO_CHARS[] = " nbrq";
+	int from = move & 63;
+	int to = (move >> 6) & 63;
+	int promo = move >> 12;
+	dst.push_back('a' + from % 8);
+	dst.push_back('1' + from / 8);
+	dst.push_back('a' + to % 8);
+	dst.push_back('1' + to / 8);
+	if (promo) dst.push_back(PROMO_CHARS[promo]);
+}
+
+bool replaySan(string_view mvs, Board& board, vector<uint16_t>& codes, vector<uint64_t>* hashes, size_t maxHashes) {
+	board.reset();
+	size_t i = 0;
+	while (i < mvs.size()) {
+		size_t end = mvs.find(' ', i);
+		if (end == string_view::npos) end = mvs.size();
+		uint16_t move;
+		if (!board.playSan(mvs.substr(i, end - i), move)) {
+			return false;
+		}
+		codes.push_back(move);
+		if (hashes && hashes->size() < maxHashes) {
+			hashes->push_back(board.hash());
+		}
+		i = end + 1;
+	}
+	return true;
+}
@@ -0,0 +1,78 @@
+#ifndef BOARD_H
+#define BOARD_H
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum Color : uint8_t {
+	WHITE,
+	BLACK
+};
+
+enum PieceType : uint8_t {
+	PAWN,
+	KNIGHT,
+	BISHOP,
+	ROOK,
+	QUEEN,
+	KING,
+	NO_PIECE
+};
+
+#define CASTLE_WK 1
+#define CASTLE_WQ 2
+#define CASTLE_BK 4
+#define CASTLE_BQ 8
+
+// Moves are encoded as from | to<<6 | promotion<<12 with squares numbered a1=0 .. h8=63
+// and promotion 0 for none, otherwise the PieceType promoted to. Castling is encoded as
+// the king's move, e.g. e1g1.
+inline uint16_t encodeMove(int from, int to, int promo) {
+	return from | (to << 6) | (promo << 12);
+}
+
+class Board {
+public:
+	Board();
+	// the standard starting position
+	void reset();
+	// plays a move given in SAN. Returns false and leaves the board unchanged if the
+	// move is malformed, illegal or ambiguous.
+	bool playSan(std::string_view san, uint16_t& move);
+	PieceType pieceAt(int sq) const;
+	Color colorAt(int sq) const;
+	Color getSideToMove() const;
+	uint8_t getCastling() const;
+	// en passant target square after a double pawn push, -1 otherwise
+	int getEpSquare() const;
+	uint64_t pieces(Color color, PieceType type) const;
+	// Zobrist hash of the position. The en passant file only counts when a pawn can
+	// actually capture there, so transpositions hash equally.
+	uint64_t hash() const;
+private:
+	uint64_t byColor[2];
+	uint64_t byType[6];
+	PieceType mailbox[64];
+	Color sideToMove;
+	uint8_t castling;
+	int epSquare;
+	// pieces, castling rights and side to move, updated incrementally
+	uint64_t key;
+	void put(int sq, Color color, PieceType type);
+	void remove(int sq);
+	void makeMove(int from, int to, int promo);
+	bool attacked(int sq, Color by, uint64_t occ) const;
+	bool leavesKingSafe(int from, int to, int promo) const;
+	bool playCastle(bool kingside, uint16_t& move);
+};
+
+void appendUci(std::string& dst, uint16_t move);
+
+// Replays space-separated SAN moves from the starting position, appending their codes
+// and, if hashes is set, the hash after each of the first maxHashes plies.
+// Returns false at the first move that can't be played.
+bool replaySan(std::string_view mvs, Board& board, std::vector<uint16_t>& codes, std::vector<uint64_t>* hashes = nullptr, size_t maxHashes = SIZE_MAX);
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Escalating wait for a queue that is full or empty: a few spins, then yields, then
+// sleeps of up to a millisecond, so an idle stage doesn't burn a core.
+class Backoff {
+public:
+	void wait() {
+		if (step < 4) {
+			for (int i=0; i<(1 << step); i++) {
+#if defined(__x86_64__) || defined(__i386__)
+				_mm_pause();
+#endif
+			}
+		} else if (step < 10) {
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(std::min(1000, 50 << std::min(step - 10, 5))));
+		}
+		step++;
+	}
+private:
+	int step = 0;
+};
+
+// Fixed-capacity multi-producer multi-consumer ring buffer (Vyukov's bounded queue).
+// Every slot carries a sequence number that tells producers and consumers whose turn
+// it is, so push and pop only contend on one atomic each. Items from one producer
+// are popped in the order they were pushed.
+template <typename T>
+class BoundedQueue {
+public:
+	// the capacity is rounded up to a power of two
+	explicit BoundedQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+		mask = size - 1;
+		cells = std::make_unique<Cell[]>(size);
+		for (size_t i=0; i<size; i++) {
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	bool tryPush(T& value) {
+		size_t pos = pushPos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell& cell = cells[pos & mask];
+			intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+			if (diff == 0) {
+				if (pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = std::move(value);
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = pushPos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool tryPop(T& value) {
+		size_t pos = popPos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell& cell = cells[pos & mask];
+			intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = std::move(cell.value);
+					cell.seq.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = popPos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// block while the queue is full
+	void push(T value) {
+		Backoff backoff;
+		while (!tryPush(value)) backoff.wait();
+	}
+
+	// block while the queue is empty
+	T pop() {
+		T value;
+		Backoff backoff;
+		while (!tryPop(value)) backoff.wait();
+		return value;
+	}
+
+	size_t capacity() const {
+		return mask + 1;
+	}
+
+private:
+	struct alignas(64) Cell {
+		std::atomic<size_t> seq;
+		T value;
+	};
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	alignas(64) std::atomic<size_t> pushPos{0};
+	alignas(64) std::atomic<size_t> popPos{0};
+};
+
+// What travels between two stages. END tells a consumer that the producer sending it
+// is done, FLUSH asks it to hand on whatever it buffers; neither carries a block.
+template <typename Block>
+struct StageMsg {
+	enum Kind : uint8_t {
+		BLOCK,
+		FLUSH,
+		END
+	};
+	Kind kind = END;
+	std::shared_ptr<Block> block;
+	StageMsg() {};
+	StageMsg(std::shared_ptr<Block> block): kind(BLOCK), block(block) {};
+	static StageMsg end() {
+		return StageMsg();
+	}
+	static StageMsg flush() {
+		StageMsg msg;
+		msg.kind = FLUSH;
+		return msg;
+	}
+};
+
+#endif
@@ -1,137 +1,265 @@
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 #include "decompress.h"
+#include "frameIndex.h"
+#include "scan.h"
 
-#define MAGIC 0xFD2FB528
-
+// Splits the archive at frame starts so that each reader gets a similar share of
+// the decompressed data (or of the compressed data if the frame headers don't record
+// content sizes).
 std::vector<size_t> getFrameBoundaries(std::string zst, int nBoundaries) {		
+	std::vector<FrameInfo> frames = loadFrameIndex(zst);
+	size_t nbytes = std::filesystem::file_size(zst);
+
+	bool haveSizes = !frames.empty();
+	for (auto& frame: frames) {
+		if (frame.decompressedSize == ZSTD_CONTENTSIZE_UNKNOWN) {
+			haveSizes = false;
+			break;
+		}
+	}
+	uint64_t total = 0;
+	for (auto& frame: frames) {
+		total += haveSizes ? frame.decompressedSize : frame.compressedSize;
+	}
+
 	std::vector<size_t> offsets;
-	size_t nbytes = std::filesystem::file_size(zst);		
-	std::ifstream infile(zst, std::ios::binary);
-	int buffers[4];
-	int idx=0;
-	for (int i=0; i<nBoundaries; i++) {
-		size_t offset = i*nbytes/nBoundaries;
-		infile.seekg(offset, infile.beg);
-		while(true) {
-			infile.read((char*)(&buffers[idx]), 4);
-			if (infile.gcount() <= 0) break;
-			if (buffers[idx] == MAGIC) {
-				try {
-					DecompressStream ds(zst, offset, nbytes, 1024);
-					ds.decompressFrame();
-				} catch (std::runtime_error e) {
-					// false framestart, probably a random, unlucky occurence of MAGIC
-					continue;
-				}
-				offsets.push_back(offset);
-				break;
-			}
-			idx = (idx+1) % 4;
-			offset++;
-			infile.seekg(-3, infile.cur);
-		}	
-	}
-	infile.close();
+	uint64_t cum = 0;
+	for (auto& frame: frames) {
+		if (offsets.size() < static_cast<size_t>(nBoundaries) && cum*nBoundaries >= offsets.size()*total) {
+			offsets.push_back(frame.offset);
+		}
+		cum += haveSizes ? frame.decompressedSize : frame.compressedSize;
+	}
+	if (offsets.empty()) {
+		offsets.push_back(0);
+	}
+	offsets[0] = 0;
 	offsets.push_back(nbytes);
 	return offsets;
 }
 
-DecompressStream::DecompressStream(std::string zstfn, size_t frameStart, size_t frameEnd, size_t frameSize) : frameSize(frameSize), rem("") {
+DecompressStream::DecompressStream(std::string zstfn, size_t frameStart, size_t frameEnd, size_t frameSize, std::shared_ptr<IoPool> ioPool, int queueDepth) 
+	: frameStart(frameStart), frameSize(frameSize), ioPool(ioPool), queueDepth(ioPool ? queueDepth : 0) {
 	maxBytes = (frameEnd-frameStart);
+	rangeBytes = maxBytes;
 	totalRead = 0;
-	in = {.src = NULL};
-    out = {.dst = NULL};
+	totalSubmitted = 0;
+	in = {NULL, 0, 0};
+    out = {NULL, 0, 0};
 
-	infile = std::ifstream(zstfn, std::ios::binary);	
-	infile.seekg(frameStart, infile.beg);
+	fd = open(zstfn.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("could not open " + zstfn);
 
  	in_mem = (char*)malloc(frameSize);	
 	in.src = in_mem;
 	in.size = frameSize;
 	in.pos = 0;
-	out.dst = malloc(frameSize);
-	out.size = frameSize;
-	out.pos = 0;
+	// one block is being decompressed while queueDepth more are in flight
+	if (this->queueDepth > 0) {
+		for (int i=0; i<this->queueDepth; i++) {
+			freeBlocks.push_back((char*)malloc(frameSize));
+		}
+		freeBlocks.push_back(in_mem);
+		in.src = NULL;
+	}
+
+	outCapacity = 8*frameSize;
+	out_mem = (char*)malloc(outCapacity);
+	outEnd = 0;
+	consumed = 0;
+	scanPos = 0;
+	streamBase = 0;
+	softEnd = SIZE_MAX;
+	haveGame = false;
+	openTag = false;
+	finished = false;
 
 	dctx = ZSTD_createDCtx();
 	
 	zstdRet = -1;
 
+	submitReads();
 }
 
 DecompressStream::~DecompressStream() {
-	free(in_mem);
-	free(out.dst);
-	infile.close();
+	for (auto& pending: pendingReads) {
+		pending.second.wait();
+		freeBlocks.push_back(pending.first);
+	}
+	if (queueDepth > 0) {
+		if (in.src != NULL) freeBlocks.push_back((char*)in.src);
+		for (auto block: freeBlocks) free(block);
+	} else {
+		free(in_mem);
+	}
+	free(out_mem);
+	ZSTD_freeDCtx(dctx);
+	close(fd);
 }
 
-std::streamsize DecompressStream::decompressFrame() {
-	if (totalRead >= maxBytes) return 0;
+void DecompressStream::submitReads() {
+	while (!freeBlocks.empty() && pendingReads.size() < static_cast<size_t>(queueDepth) && totalSubmitted < maxBytes) {
+		size_t bytesToRead = std::min(frameSize, maxBytes-totalSubmitted);
+		char* block = freeBlocks.back();
+		freeBlocks.pop_back();
+		pendingReads.emplace_back(block, ioPool->read(fd, frameStart+totalSubmitted, bytesToRead, block));
+		totalSubmitted += bytesToRead;
+	}
+}
 
+std::streamsize DecompressStream::readBlock() {
 	size_t bytesToRead = std::min(frameSize, maxBytes-totalRead);
-	infile.read(static_cast<char*>(in_mem), bytesToRead);
-	std::streamsize bytesRead = infile.gcount();
+	if (queueDepth == 0) {
+		return preadFull(fd, frameStart+totalRead, bytesToRead, in_mem);
+	}
+	// the previous block has been fully consumed by zstd, so its buffer can be reused
+	if (in.src != NULL) {
+		freeBlocks.push_back((char*)in.src);
+		in.src = NULL;
+	}
+	submitReads();
+	if (pendingReads.empty()) {
+		// reads that came back short at the end of the file leave totalSubmitted ahead
+		// of totalRead, so nothing is in flight; with no read pending a block is free
+		in.src = freeBlocks.back();
+		freeBlocks.pop_back();
+		return preadFull(fd, frameStart+totalRead, bytesToRead, (char*)in.src);
+	}
+	auto [block, result] = std::move(pendingReads.front());
+	pendingReads.pop_front();
+	in.src = block;
+	submitReads();
+	return result.get();
+}
+
+void DecompressStream::reserveOutput(size_t nbytes) {
+	if (outCapacity - outEnd >= nbytes) return;
+	outCapacity = std::max(2*outCapacity, outEnd + nbytes);
+	out_mem = (char*)realloc(out_mem, outCapacity);
+	if (out_mem == NULL) throw std::runtime_error("failed to grow decompression buffer");
+}
+
+std::streamsize DecompressStream::decompressFrame() {
+	if (finished || totalRead >= maxBytes) return 0;
+
+	// carry the unconsumed tail of the previous frame over to the front of the buffer
+	size_t remSize = outEnd - consumed;
+	if (consumed > 0) {
+		memmove(out_mem, out_mem + consumed, remSize);
+	}
+	outEnd = remSize;
+	scanPos -= consumed;
+	streamBase += consumed;
+	consumed = 0;
+
+	std::streamsize bytesRead = readBlock();
+	if (bytesRead < 0) throw std::runtime_error("read failed at offset " + std::to_string(frameStart+totalRead));
 	totalRead += bytesRead;
-	if (bytesRead < 0) throw std::runtime_error("bytesRead < 0");
 	in.size = bytesRead;
 	in.pos = 0;
 
-	while(true) {
-		if (zstdRet == 0 && in.pos == in.size) break;
-
+	bool outputFull = false;
+	while (in.pos < in.size || outputFull) {
+		reserveOutput(ZSTD_DStreamOutSize());
+		out.dst = out_mem + outEnd;
+		out.size = outCapacity - outEnd;
 		out.pos = 0;
 		zstdRet = ZSTD_decompressStream(dctx, &out, &in); 
 		if (ZSTD_isError(zstdRet)) {
 			throw std::runtime_error("zstd returned " + std::string(ZSTD_getErrorName(zstdRet)));
 		}
-		ss.write(reinterpret_cast<const char*>(out.dst), out.pos);
+		outEnd += out.pos;
+		outputFull = out.pos == out.size;
+	}
+	return bytesRead;
+}
 
-		if (in.pos == in.size) {
-			if (bytesRead == 0 && zstdRet == 0 && out.pos == out.size) {
-				continue;
-			}
+void DecompressStream::getLines(std::vector<std::string_view>& lines) {
+	while (true) {
+		char* next = (char*)memchr(out_mem + scanPos, '\n', outEnd - scanPos);
+		if (next == NULL) {
+			scanPos = outEnd;
 			break;
 		}
+		size_t lineEnd = next - out_mem;
+		lines.emplace_back(out_mem + consumed, lineEnd - consumed);
+		consumed = lineEnd + 1;
+		scanPos = consumed;
 	}
-	return bytesRead;
 }
 
-void DecompressStream::getLines(std::vector<std::string>& lines) {
-	std::string frame = ss.str();
-	ss.str(std::string());
-
-	int offset = 0;
-	int next = frame.find('\n', offset);
-	if (next == std::string::npos) {
-		rem += frame;
+void DecompressStream::getGames(std::vector<std::string_view>& games) {
+	openTag = false;
+	if (outEnd < 7 || scanPos >= outEnd - 6) {
+		findOpenTag();
 		return;
 	}
+	// a tag that could still be cut off by the end of the buffer is left for the next call
+	size_t end = outEnd - 6;
+	starts.clear();
+	findGameStarts(out_mem, scanPos, end, starts);
+	scanPos = end;
+	for (auto start: starts) {
+		if (haveGame) {
+			games.emplace_back(out_mem + consumed, start - consumed);
+		}
+		consumed = start;
+		haveGame = true;
+		if (streamBase + start >= softEnd) {
+			// this game belongs to the next range
+			haveGame = false;
+			finished = true;
+			return;
+		}
+	}
+	if (!haveGame) {
+		// keep the byte before scanPos, it decides whether scanPos starts a line
+		consumed = scanPos - 1;
+	}
+	findOpenTag();
+}
 
-	rem += frame.substr(offset, next);
-	lines.push_back(rem);
-	rem = "";
-	offset = next+1;
-
-	while(true) {
-		next = frame.find('\n', offset);
-		if (next == std::string::npos) {
-			rem = frame.substr(offset);
-		   	break;
+// Once the whole range is in the buffer, an [Event line cut off by its end starts a
+// game that the next range can't see, so this range has to extend to read it.
+void DecompressStream::findOpenTag() {
+	static const char EVENT_TAG[] = "[Event ";
+	if (totalRead < maxBytes || haveGame) return;
+	for (size_t p = std::max(scanPos, outEnd < 6 ? 0 : outEnd - 6); p < outEnd; p++) {
+		if ((p == 0 || out_mem[p-1] == '\n') && memcmp(out_mem + p, EVENT_TAG, outEnd - p) == 0) {
+			openTag = true;
+			return;
 		}
-		std::string line = frame.substr(offset, next-offset);
-		lines.push_back(line);
-		offset = next+1;
 	}
 }
 
+bool DecompressStream::pendingGame() {
+	return haveGame || openTag;
+}
+
+std::string_view DecompressStream::getRemainder() {
+	// an [Event line cut off by the end of the file is not a game
+	if (openTag && !haveGame) return std::string_view();
+	return std::string_view(out_mem + consumed, outEnd - consumed);
+}
+
+void DecompressStream::extend(size_t frameEnd) {
+	if (softEnd == SIZE_MAX) {
+		softEnd = streamBase + outEnd;
+	}
+	maxBytes = std::max(maxBytes, frameEnd-frameStart);
+}
+
 size_t DecompressStream::getFrameSize() {
 	return frameSize;
 }
 
 float DecompressStream::getProgress() {
-	return (float)totalRead / (float)maxBytes;
+	return std::min(1.0f, (float)totalRead / (float)rangeBytes);
 }
 
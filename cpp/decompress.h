@@ -1,8 +1,13 @@
 #include "zstd.h"
-#include <fstream>
+#include <cstdint>
+#include <deque>
+#include <future>
 #include <ios>
-#include <sstream>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
+#include "ioPool.h"
 
 std::vector<size_t> getFrameBoundaries(std::string zst, int nBoundaries);
 
@@ -12,18 +17,53 @@ class DecompressStream {
 	ZSTD_outBuffer out;
 	char* in_mem;
 	char* out_mem;
-	std::ifstream infile;
-	std::stringstream ss;
+	size_t outCapacity;
+	size_t outEnd;
+	size_t consumed;
+	size_t scanPos;
+	// decompressed stream offset of out_mem[0]
+	size_t streamBase;
+	// decompressed size of the original range, known once extend is called
+	size_t softEnd;
+	bool haveGame;
+	// the buffer ends in what may be the start of an [Event line
+	bool openTag;
+	bool finished;
+	std::vector<size_t> starts;
+	int fd;
 	size_t zstdRet;
+	size_t frameStart;
 	size_t frameSize;
 	size_t maxBytes;
+	size_t rangeBytes;
 	size_t totalRead;
-	std::string rem;
+	size_t totalSubmitted;
+	std::shared_ptr<IoPool> ioPool;
+	int queueDepth;
+	std::vector<char*> freeBlocks;
+	std::deque<std::pair<char*, std::future<ssize_t> > > pendingReads;
+	void reserveOutput(size_t nbytes);
+	void submitReads();
+	std::streamsize readBlock();
+	void findOpenTag();
 public:
-	DecompressStream(std::string zstfn, size_t frameStart, size_t frameEnd, size_t frameSize=1024*1024);
+	DecompressStream(std::string zstfn, size_t frameStart, size_t frameEnd, size_t frameSize=1024*1024, std::shared_ptr<IoPool> ioPool=nullptr, int queueDepth=0);
 	~DecompressStream();
 	std::streamsize decompressFrame();
-	void getLines(std::vector<std::string>& lines);
+	// views point into the decompression buffer and are only valid until the next call to decompressFrame
+	void getLines(std::vector<std::string_view>& lines);
+	// complete games, each running from its [Event line to the next one. Bytes before
+	// the first [Event line belong to the previous range and are dropped. After extend,
+	// the stream finishes with the game that is open at the original end of the range.
+	void getGames(std::vector<std::string_view>& games);
+	// true if a game has started, or may have at the end of the range, but its end
+	// hasn't been seen yet
+	bool pendingGame();
+	// bytes not yet returned by getLines or getGames, e.g. a final line that is not
+	// newline-terminated or the last game of the file
+	std::string_view getRemainder();
+	// continue reading past the original end of the range, up to frameEnd
+	void extend(size_t frameEnd);
 	size_t getFrameSize();
 	float getProgress();
 };	
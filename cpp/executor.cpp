@@ -0,0 +1,140 @@
+#include <algorithm>
+#include "executor.h"
+
+// the executor and worker the current thread belongs to, if any
+static thread_local Executor* currentExecutor = nullptr;
+static thread_local size_t currentWorker = 0;
+
+Executor::Executor(size_t nThreads): nQueued(0), nextWorker(0), stop(false), nRunning(0), failed(false) {
+	if (nThreads == 0) {
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (size_t i=0; i<nThreads; i++) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+	for (size_t i=0; i<nThreads; i++) {
+		threads.emplace_back(&Executor::run, this, i);
+	}
+}
+
+Executor::~Executor() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMtx);
+		stop = true;
+	}
+	sleepCv.notify_all();
+	for (auto& thread: threads) {
+		thread.join();
+	}
+}
+
+size_t Executor::size() const {
+	return workers.size();
+}
+
+void Executor::submit(std::function<void()> task) {
+	size_t id;
+	if (currentExecutor == this) {
+		id = currentWorker;
+	} else {
+		// spread tasks from outside threads over the workers
+		id = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+	}
+	// counted first, so that a worker taking the task right away can't take nQueued below 0
+	nQueued++;
+	{
+		std::lock_guard<std::mutex> lock(workers[id]->mtx);
+		workers[id]->tasks.push_back(std::move(task));
+	}
+	{
+		// a worker going to sleep checks nQueued under sleepMtx, so this can't be missed
+		std::lock_guard<std::mutex> lock(sleepMtx);
+	}
+	sleepCv.notify_one();
+}
+
+bool Executor::take(size_t id, std::function<void()>& task) {
+	{
+		Worker& own = *workers[id];
+		std::lock_guard<std::mutex> lock(own.mtx);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for (size_t i=1; i<workers.size(); i++) {
+		Worker& victim = *workers[(id + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mtx);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void Executor::run(size_t id) {
+	currentExecutor = this;
+	currentWorker = id;
+	std::function<void()> task;
+	while (true) {
+		if (take(id, task)) {
+			nQueued--;
+			// counted before failed is read, so that wait can't miss a task that runs
+			nRunning++;
+			if (!failed) {
+				try {
+					task();
+				} catch (...) {
+					fail(std::current_exception());
+				}
+			}
+			task = nullptr;
+			if (--nRunning == 0 && failed) {
+				notify();
+			}
+			continue;
+		}
+		if (nQueued > 0) {
+			// counted but not pushed yet, or being taken by another worker
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMtx);
+		sleepCv.wait(lock, [this]{ return stop || nQueued > 0; });
+		if (stop && nQueued == 0) return;
+	}
+}
+
+// a task that throws leaves whatever it was part of unfinished, so nothing that
+// depends on it can be trusted to finish either
+void Executor::fail(std::exception_ptr e) {
+	{
+		std::lock_guard<std::mutex> lock(waitMtx);
+		if (!error) {
+			error = e;
+		}
+		failed = true;
+	}
+	waitCv.notify_all();
+}
+
+void Executor::wait(const std::function<bool()>& done) {
+	std::unique_lock<std::mutex> lock(waitMtx);
+	waitCv.wait(lock, [&] { return done() || (failed && nRunning == 0); });
+}
+
+void Executor::notify() {
+	{
+		// a waiter checks done under waitMtx, so this can't be missed
+		std::lock_guard<std::mutex> lock(waitMtx);
+	}
+	waitCv.notify_all();
+}
+
+std::exception_ptr Executor::failure() {
+	std::lock_guard<std::mutex> lock(waitMtx);
+	return error;
+}
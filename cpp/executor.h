@@ -0,0 +1,55 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool-wide work-stealing task scheduler. Every worker owns a deque: tasks submitted
+// from a worker go on its own deque and are run newest first, and a worker that runs
+// out of tasks steals the oldest ones from the others. Tasks must not block on other
+// tasks; a task that has to wait hands a continuation to whatever it waits for.
+class Executor {
+public:
+	// nThreads 0 means one worker per hardware thread
+	explicit Executor(size_t nThreads = 0);
+	// runs every task that is still queued, then joins the workers
+	~Executor();
+	void submit(std::function<void()> task);
+	size_t size() const;
+	// blocks a thread outside the executor until done returns true, or until a task
+	// has thrown and none is running any more; tasks call notify once done may be true
+	void wait(const std::function<bool()>& done);
+	void notify();
+	// the first exception a task threw, if any; the tasks queued after it are dropped
+	std::exception_ptr failure();
+private:
+	struct Worker {
+		std::mutex mtx;
+		std::deque<std::function<void()> > tasks;
+	};
+	std::vector<std::unique_ptr<Worker> > workers;
+	std::vector<std::thread> threads;
+	// tasks submitted and not yet taken, so that idle workers know when to sleep
+	std::atomic<size_t> nQueued;
+	std::atomic<size_t> nextWorker;
+	std::mutex sleepMtx;
+	std::condition_variable sleepCv;
+	bool stop;
+	std::atomic<size_t> nRunning;
+	std::atomic<bool> failed;
+	std::exception_ptr error;
+	std::mutex waitMtx;
+	std::condition_variable waitCv;
+
+	void run(size_t id);
+	void fail(std::exception_ptr e);
+	bool take(size_t id, std::function<void()>& task);
+};
+
+#endif
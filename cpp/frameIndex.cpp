@@ -0,0 +1,195 @@
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "zstd.h"
+#include "frameIndex.h"
+
+namespace fs = std::filesystem;
+
+#define INDEX_MAGIC 0x3158444950505A50ULL // "PZPPIDX1"
+#define FRAME_HEADER_MAX 18
+
+struct IndexHeader {
+	uint64_t magic;
+	uint64_t fileSize;
+	int64_t mtime;
+	uint64_t nFrames;
+};
+
+static bool readAt(std::ifstream& infile, uint64_t offset, unsigned char* buf, size_t n) {
+	infile.clear();
+	infile.seekg(offset, infile.beg);
+	infile.read(reinterpret_cast<char*>(buf), n);
+	return infile.gcount() == static_cast<std::streamsize>(n);
+}
+
+static uint32_t readLE(const unsigned char* buf, int n) {
+	uint32_t val = 0;
+	for (int i=n-1; i>=0; i--) {
+		val = (val << 8) | buf[i];
+	}
+	return val;
+}
+
+static int64_t getMtime(std::string zst) {
+	return fs::last_write_time(zst).time_since_epoch().count();
+}
+
+std::string frameIndexPath(std::string zst) {
+	return zst + ".idx";
+}
+
+// Walks the frame and block headers of the archive without decompressing anything.
+// A frame that is cut off by the end of the file (e.g. a partial download) is kept
+// and extends to the end of the file.
+std::vector<FrameInfo> buildFrameIndex(std::string zst) {
+	static const int DID_SIZE[4] = {0, 1, 2, 4};
+	static const int FCS_SIZE[4] = {0, 2, 4, 8};
+
+	std::vector<FrameInfo> frames;
+	uint64_t nbytes = fs::file_size(zst);
+	std::ifstream infile(zst, std::ios::binary);
+	unsigned char buf[FRAME_HEADER_MAX];
+	uint64_t offset = 0;
+
+	while (offset < nbytes) {
+		if (!readAt(infile, offset, buf, 8)) {
+			throw std::runtime_error("truncated zstd frame at offset " + std::to_string(offset) + " in " + zst);
+		}
+		uint32_t magic = readLE(buf, 4);
+		if ((magic & 0xFFFFFFF0) == ZSTD_MAGIC_SKIPPABLE_START) {
+			offset += 8 + readLE(buf+4, 4);
+			continue;
+		}
+		if (magic != ZSTD_MAGICNUMBER) {
+			throw std::runtime_error("invalid zstd frame at offset " + std::to_string(offset) + " in " + zst);
+		}
+
+		size_t avail = std::min<uint64_t>(FRAME_HEADER_MAX, nbytes-offset);
+		readAt(infile, offset, buf, avail);
+		unsigned char fhd = buf[4];
+		bool singleSegment = (fhd >> 5) & 1;
+		bool checksum = (fhd >> 2) & 1;
+		int fcsSize = FCS_SIZE[fhd >> 6];
+		if (fcsSize == 0 && singleSegment) fcsSize = 1;
+		uint64_t headerSize = 5 + (singleSegment ? 0 : 1) + DID_SIZE[fhd & 3] + fcsSize;
+
+		FrameInfo frame = {offset, 0, ZSTD_getFrameContentSize(buf, avail)};
+		if (frame.decompressedSize == ZSTD_CONTENTSIZE_ERROR) {
+			throw std::runtime_error("invalid zstd frame header at offset " + std::to_string(offset) + " in " + zst);
+		}
+
+		uint64_t pos = offset + headerSize;
+		bool truncated = false;
+		while (true) {
+			if (!readAt(infile, pos, buf, 3)) {
+				truncated = true;
+				break;
+			}
+			uint32_t blockHeader = readLE(buf, 3);
+			int blockType = (blockHeader >> 1) & 3;
+			if (blockType == 3) {
+				throw std::runtime_error("invalid zstd block at offset " + std::to_string(pos) + " in " + zst);
+			}
+			pos += 3 + (blockType == 1 ? 1 : (blockHeader >> 3));
+			if (blockHeader & 1) break;
+		}
+		if (checksum) pos += 4;
+		if (truncated || pos > nbytes) pos = nbytes;
+
+		frame.compressedSize = pos - offset;
+		frames.push_back(frame);
+		offset = pos;
+	}
+	return frames;
+}
+
+// Reads the seek table appended by reframeZst (or any writer of the zstd seekable format)
+bool readSeekTable(std::string zst, std::vector<FrameInfo>& frames) {
+	uint64_t nbytes = fs::file_size(zst);
+	if (nbytes < 17) return false;
+	std::ifstream infile(zst, std::ios::binary);
+	unsigned char footer[9];
+	infile.seekg(nbytes-9, infile.beg);
+	infile.read(reinterpret_cast<char*>(footer), 9);
+	if (infile.gcount() != 9 || readLE(footer+5, 4) != SEEKABLE_MAGIC) return false;
+
+	uint64_t nFrames = readLE(footer, 4);
+	bool checksums = footer[4] & 0x80;
+	uint64_t entrySize = checksums ? 12 : 8;
+	uint64_t tableSize = 8 + nFrames*entrySize + 9;
+	if (tableSize > nbytes) return false;
+
+	std::vector<unsigned char> table(tableSize);
+	infile.seekg(nbytes-tableSize, infile.beg);
+	infile.read(reinterpret_cast<char*>(table.data()), tableSize);
+	if (infile.gcount() != static_cast<std::streamsize>(tableSize) ||
+			readLE(table.data(), 4) != SEEK_TABLE_SKIPPABLE_MAGIC ||
+			readLE(table.data()+4, 4) != tableSize-8) {
+		return false;
+	}
+
+	frames.clear();
+	uint64_t offset = 0;
+	for (uint64_t i=0; i<nFrames; i++) {
+		const unsigned char* entry = table.data() + 8 + i*entrySize;
+		FrameInfo frame = {offset, readLE(entry, 4), readLE(entry+4, 4)};
+		frames.push_back(frame);
+		offset += frame.compressedSize;
+	}
+	if (offset != nbytes-tableSize) {
+		frames.clear();
+		return false;
+	}
+	return true;
+}
+
+bool readFrameIndex(std::string zst, std::vector<FrameInfo>& frames) {
+	std::ifstream idxfile(frameIndexPath(zst), std::ios::binary);
+	if (!idxfile) return false;
+
+	IndexHeader header;
+	idxfile.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (idxfile.gcount() != sizeof(header) ||
+			header.magic != INDEX_MAGIC ||
+			header.fileSize != fs::file_size(zst) ||
+			header.mtime != getMtime(zst)) {
+		return false;
+	}
+
+	frames.resize(header.nFrames);
+	size_t nbytes = header.nFrames * sizeof(FrameInfo);
+	idxfile.read(reinterpret_cast<char*>(frames.data()), nbytes);
+	if (idxfile.gcount() != static_cast<std::streamsize>(nbytes)) {
+		frames.clear();
+		return false;
+	}
+	return true;
+}
+
+bool writeFrameIndex(std::string zst, std::vector<FrameInfo>& frames) {
+	IndexHeader header = {INDEX_MAGIC, fs::file_size(zst), getMtime(zst), frames.size()};
+	std::string fn = frameIndexPath(zst);
+	std::string tmp = fn + ".tmp";
+	{
+		std::ofstream idxfile(tmp, std::ios::binary | std::ios::trunc);
+		if (!idxfile) return false;
+		idxfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		idxfile.write(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(FrameInfo));
+		if (!idxfile) return false;
+	}
+	std::error_code ec;
+	fs::rename(tmp, fn, ec);
+	return !ec;
+}
+
+std::vector<FrameInfo> loadFrameIndex(std::string zst) {
+	std::vector<FrameInfo> frames;
+	if (readSeekTable(zst, frames) || readFrameIndex(zst, frames)) {
+		return frames;
+	}
+	frames = buildFrameIndex(zst);
+	// the sidecar is only a cache, so a read-only archive directory is not an error
+	writeFrameIndex(zst, frames);
+	return frames;
+}
@@ -0,0 +1,23 @@
+#ifndef FRAME_INDEX_H
+#define FRAME_INDEX_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SEEKABLE_MAGIC 0x8F92EAB1
+#define SEEK_TABLE_SKIPPABLE_MAGIC 0x184D2A5E
+
+struct FrameInfo {
+	uint64_t offset;
+	uint64_t compressedSize;
+	uint64_t decompressedSize; // ZSTD_CONTENTSIZE_UNKNOWN if the frame header does not record it
+};
+
+std::string frameIndexPath(std::string zst);
+std::vector<FrameInfo> buildFrameIndex(std::string zst);
+bool readSeekTable(std::string zst, std::vector<FrameInfo>& frames);
+bool readFrameIndex(std::string zst, std::vector<FrameInfo>& frames);
+bool writeFrameIndex(std::string zst, std::vector<FrameInfo>& frames);
+std::vector<FrameInfo> loadFrameIndex(std::string zst);
+
+#endif
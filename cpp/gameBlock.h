@@ -0,0 +1,73 @@
+#ifndef GAME_BLOCK_H
+#define GAME_BLOCK_H
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Strings stored back to back, so that a block of games needs one buffer instead of
+// one allocation per game.
+struct PackedStrings {
+	std::vector<char> values;
+	std::vector<uint32_t> ends;
+
+	void push(std::string_view s) {
+		values.insert(values.end(), s.begin(), s.end());
+		ends.push_back(values.size());
+	}
+	size_t begin(size_t i) const {
+		return i == 0 ? 0 : ends[i-1];
+	}
+	std::string_view get(size_t i) const {
+		return std::string_view(values.data() + begin(i), ends[i] - begin(i));
+	}
+	void clear() {
+		values.clear();
+		ends.clear();
+	}
+};
+
+// Up to 100 consecutive games of one reader, as found in the decompressed stream.
+struct GameBlock {
+	int pid;
+	// of the reader, after the last game of the block
+	float progress;
+	PackedStrings games;
+
+	size_t size() const {
+		return games.ends.size();
+	}
+	void clear() {
+		games.clear();
+	}
+};
+
+// Recycles blocks, which keep the capacity of their buffers from one use to the
+// next. Blocks are owned by the list and handed out as plain pointers.
+template <typename Block>
+class BlockFreeList {
+public:
+	Block* take() {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (free.empty()) {
+			owned.push_back(std::make_unique<Block>());
+			return owned.back().get();
+		}
+		Block* block = free.back();
+		free.pop_back();
+		return block;
+	}
+	void give(Block* block) {
+		block->clear();
+		std::lock_guard<std::mutex> lock(mtx);
+		free.push_back(block);
+	}
+private:
+	std::mutex mtx;
+	std::vector<Block*> free;
+	std::vector<std::unique_ptr<Block> > owned;
+};
+
+#endif
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include "gameFilter.h"
+
+using namespace std;
+
+static bool parseInt64(string_view str, int64_t& val) {
+	if (str.empty()) return false;
+	auto res = from_chars(str.data(), str.data() + str.size(), val);
+	return res.ec == errc() && res.ptr == str.data() + str.size();
+}
+
+static inline bool isWordChar(char c) {
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+GameFilter::GameFilter(string expr): expr(expr), pos(0) {
+	root = parseOr();
+	skipSpace();
+	if (pos != this->expr.size()) {
+		fail("unexpected input");
+	}
+}
+
+const vector<string>& GameFilter::getTags() const {
+	return tags;
+}
+
+bool GameFilter::matches(const vector<string_view>& tagValues) const {
+	return evalBool(root, tagValues);
+}
+
+void GameFilter::skipSpace() {
+	while (pos < expr.size() && isspace((unsigned char)expr[pos])) pos++;
+}
+
+bool GameFilter::accept(string_view token) {
+	skipSpace();
+	if (expr.compare(pos, token.size(), token) == 0) {
+		pos += token.size();
+		return true;
+	}
+	return false;
+}
+
+bool GameFilter::acceptWord(string_view word) {
+	skipSpace();
+	if (pos + word.size() > expr.size()) return false;
+	for (size_t i=0; i<word.size(); i++) {
+		if (tolower((unsigned char)expr[pos+i]) != word[i]) return false;
+	}
+	if (pos + word.size() < expr.size() && isWordChar(expr[pos + word.size()])) return false;
+	pos += word.size();
+	return true;
+}
+
+void GameFilter::fail(string msg) {
+	throw runtime_error("invalid filter at position " + to_string(pos) + ": " + msg + " in \"" + expr + "\"");
+}
+
+int GameFilter::addNode(NodeType type, int lhs, int rhs) {
+	nodes.push_back({type, lhs, rhs, 0, "", {}});
+	return nodes.size() - 1;
+}
+
+int GameFilter::parseOr() {
+	int node = parseAnd();
+	while (acceptWord("or") || accept("||")) {
+		node = addNode(OR, node, parseAnd());
+	}
+	return node;
+}
+
+int GameFilter::parseAnd() {
+	int node = parseNot();
+	while (acceptWord("and") || accept("&&")) {
+		node = addNode(AND, node, parseNot());
+	}
+	return node;
+}
+
+int GameFilter::parseNot() {
+	skipSpace();
+	if (acceptWord("not") || (expr.compare(pos, 2, "!=") != 0 && accept("!"))) {
+		return addNode(NOT, parseNot(), -1);
+	}
+	if (accept("(")) {
+		int node = parseOr();
+		if (!accept(")")) fail("expected ')'");
+		return node;
+	}
+	return parseComparison();
+}
+
+int GameFilter::parseComparison() {
+	int lhs = parseSum();
+	static const pair<string_view, NodeType> OPS[] = {
+		{"==", EQ}, {"!=", NE}, {"<=", LE}, {">=", GE}, {"=", EQ}, {"<", LT}, {">", GT}
+	};
+	for (auto [token, type]: OPS) {
+		if (accept(token)) {
+			return addNode(type, lhs, parseSum());
+		}
+	}
+	if (acceptWord("contains")) {
+		return addNode(CONTAINS, lhs, parseSum());
+	}
+	bool negate = acceptWord("not");
+	if (!acceptWord("in")) {
+		fail(negate ? "expected 'in'" : "expected a comparison");
+	}
+	if (!accept("(")) fail("expected '('");
+	int node = addNode(IN, lhs, -1);
+	do {
+		int item = parseLiteral();
+		nodes[node].items.push_back(item);
+	} while (accept(","));
+	if (!accept(")")) fail("expected ')'");
+	return negate ? addNode(NOT, node, -1) : node;
+}
+
+int GameFilter::parseSum() {
+	int node = parseValue();
+	while (true) {
+		if (accept("+")) {
+			node = addNode(ADD, node, parseValue());
+		} else if (accept("-")) {
+			node = addNode(SUB, node, parseValue());
+		} else {
+			return node;
+		}
+	}
+}
+
+int GameFilter::parseValue() {
+	skipSpace();
+	if (acceptWord("abs")) {
+		if (!accept("(")) fail("expected '('");
+		int node = addNode(ABS, parseSum(), -1);
+		if (!accept(")")) fail("expected ')'");
+		return node;
+	}
+	if (pos < expr.size() && isalpha((unsigned char)expr[pos])) {
+		size_t start = pos;
+		while (pos < expr.size() && isWordChar(expr[pos])) pos++;
+		string tag = expr.substr(start, pos - start);
+		int node = addNode(TAG, -1, -1);
+		nodes[node].num = find(tags.begin(), tags.end(), tag) - tags.begin();
+		if (nodes[node].num == (int64_t)tags.size()) {
+			tags.push_back(tag);
+		}
+		return node;
+	}
+	return parseLiteral();
+}
+
+int GameFilter::parseLiteral() {
+	skipSpace();
+	if (pos < expr.size() && (expr[pos] == '"' || expr[pos] == '\'')) {
+		char quote = expr[pos];
+		size_t end = expr.find(quote, pos + 1);
+		if (end == string::npos) fail("unterminated string");
+		int node = addNode(STRING, -1, -1);
+		nodes[node].str = expr.substr(pos + 1, end - pos - 1);
+		pos = end + 1;
+		return node;
+	}
+	size_t start = pos;
+	if (pos < expr.size() && expr[pos] == '-') pos++;
+	while (pos < expr.size() && isdigit((unsigned char)expr[pos])) pos++;
+	int64_t num;
+	if (!parseInt64(string_view(expr).substr(start, pos - start), num)) {
+		pos = start;
+		fail("expected a tag name, number or string");
+	}
+	int node = addNode(NUMBER, -1, -1);
+	nodes[node].num = num;
+	return node;
+}
+
+GameFilter::Value GameFilter::evalValue(int id, const vector<string_view>& tagValues) const {
+	const Node& node = nodes[id];
+	Value val = {string_view(), 0, false, false};
+	switch (node.type) {
+		case TAG:
+			val.str = tagValues[node.num];
+			val.hasStr = true;
+			val.isNum = parseInt64(val.str, val.num);
+			break;
+		case NUMBER:
+			val.num = node.num;
+			val.isNum = true;
+			break;
+		case STRING:
+			val.str = node.str;
+			val.hasStr = true;
+			break;
+		case ADD:
+		case SUB: {
+			Value lhs = evalValue(node.lhs, tagValues);
+			Value rhs = evalValue(node.rhs, tagValues);
+			val.isNum = lhs.isNum && rhs.isNum;
+			val.num = node.type == ADD ? lhs.num + rhs.num : lhs.num - rhs.num;
+			break;
+		}
+		case ABS: {
+			Value arg = evalValue(node.lhs, tagValues);
+			val.isNum = arg.isNum;
+			val.num = arg.num < 0 ? -arg.num : arg.num;
+			break;
+		}
+		default:
+			break;
+	}
+	return val;
+}
+
+bool GameFilter::evalBool(int id, const vector<string_view>& tagValues) const {
+	const Node& node = nodes[id];
+	switch (node.type) {
+		case AND:
+			return evalBool(node.lhs, tagValues) && evalBool(node.rhs, tagValues);
+		case OR:
+			return evalBool(node.lhs, tagValues) || evalBool(node.rhs, tagValues);
+		case NOT:
+			return !evalBool(node.lhs, tagValues);
+		case IN: {
+			Value lhs = evalValue(node.lhs, tagValues);
+			for (int item: node.items) {
+				Value rhs = evalValue(item, tagValues);
+				if (lhs.isNum && rhs.isNum ? lhs.num == rhs.num : lhs.hasStr && rhs.hasStr && lhs.str == rhs.str) {
+					return true;
+				}
+			}
+			return false;
+		}
+		default:
+			break;
+	}
+
+	Value lhs = evalValue(node.lhs, tagValues);
+	Value rhs = evalValue(node.rhs, tagValues);
+	if (node.type == CONTAINS) {
+		return lhs.hasStr && rhs.hasStr && lhs.str.find(rhs.str) != string_view::npos;
+	}
+	int cmp;
+	if (lhs.isNum && rhs.isNum) {
+		cmp = lhs.num < rhs.num ? -1 : lhs.num > rhs.num;
+	} else if (lhs.hasStr && rhs.hasStr) {
+		cmp = lhs.str.compare(rhs.str);
+	} else {
+		return false;
+	}
+	switch (node.type) {
+		case EQ: return cmp == 0;
+		case NE: return cmp != 0;
+		case LT: return cmp < 0;
+		case LE: return cmp <= 0;
+		case GT: return cmp > 0;
+		case GE: return cmp >= 0;
+		default: return false;
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef GAME_FILTER_H
+#define GAME_FILTER_H
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A boolean expression over PGN header tags, compiled once and evaluated for every
+// game before its moves are parsed, e.g.
+//
+//   Event contains "Blitz" and WhiteElo >= 1500 and WhiteElo < 2200
+//     and abs(WhiteElo - BlackElo) <= 200 and Variant in ("Standard", "Chess960")
+//     and UTCDate >= "2024.01.01"
+//
+// Comparisons (== != < <= > >=) are numeric when both sides are integers and
+// lexicographic otherwise, which orders PGN dates correctly. A tag that is missing
+// from a game compares as "", and a comparison between a number and a non-numeric
+// value is false. Expressions combine with and, or, not and parentheses; values with
+// +, - and abs().
+class GameFilter {
+public:
+	// throws std::runtime_error if expr is not a valid filter
+	GameFilter(std::string expr);
+	// the tags the filter reads; matches takes their values in this order
+	const std::vector<std::string>& getTags() const;
+	bool matches(const std::vector<std::string_view>& tagValues) const;
+
+private:
+	enum NodeType : uint8_t {
+		AND, OR, NOT,
+		EQ, NE, LT, LE, GT, GE, CONTAINS, IN,
+		TAG, NUMBER, STRING, ADD, SUB, ABS
+	};
+	struct Node {
+		NodeType type;
+		int lhs;
+		int rhs;
+		// tag slot for TAG, value for NUMBER
+		int64_t num;
+		std::string str;
+		// the literals of IN
+		std::vector<int> items;
+	};
+	struct Value {
+		std::string_view str;
+		int64_t num;
+		bool hasStr;
+		bool isNum;
+	};
+	std::string expr;
+	size_t pos;
+	std::vector<Node> nodes;
+	std::vector<std::string> tags;
+	int root;
+
+	// recursive descent over expr
+	void skipSpace();
+	bool accept(std::string_view token);
+	bool acceptWord(std::string_view word);
+	[[noreturn]] void fail(std::string msg);
+	int addNode(NodeType type, int lhs, int rhs);
+	int parseOr();
+	int parseAnd();
+	int parseNot();
+	int parseComparison();
+	int parseSum();
+	int parseValue();
+	int parseLiteral();
+
+	Value evalValue(int node, const std::vector<std::string_view>& tagValues) const;
+	bool evalBool(int node, const std::vector<std::string_view>& tagValues) const;
+};
+
+#endif
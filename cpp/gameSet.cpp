@@ -0,0 +1,92 @@
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "gameSet.h"
+
+using namespace std;
+
+uint64_t gameFingerprint(string_view data) {
+	// FNV-1a followed by the splitmix64 finalizer, which spreads it over all the bits
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (unsigned char c: data) {
+		h = (h ^ c) * 0x100000001b3ULL;
+	}
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return h == 0 ? 1 : h;
+}
+
+bool GameSet::insertSlot(vector<uint64_t>& slots, uint64_t fp) {
+	size_t mask = slots.size() - 1;
+	// the high bits picked the shard, probe from the low ones
+	for (size_t i = fp & mask; ; i = (i + 1) & mask) {
+		if (slots[i] == fp) return false;
+		if (slots[i] == 0) {
+			slots[i] = fp;
+			return true;
+		}
+	}
+}
+
+bool GameSet::insert(uint64_t fp) {
+	Shard& shard = shards[fp >> (64 - SHARD_BITS)];
+	lock_guard<mutex> lock(shard.mtx);
+	if (2*(shard.count + 1) > shard.slots.size()) {
+		vector<uint64_t> grown(max<size_t>(1024, 2*shard.slots.size()), 0);
+		for (auto old: shard.slots) {
+			if (old != 0) insertSlot(grown, old);
+		}
+		shard.slots.swap(grown);
+	}
+	if (!insertSlot(shard.slots, fp)) {
+		return false;
+	}
+	shard.count++;
+	return true;
+}
+
+size_t GameSet::size() {
+	size_t n = 0;
+	for (auto& shard: shards) {
+		lock_guard<mutex> lock(shard.mtx);
+		n += shard.count;
+	}
+	return n;
+}
+
+void GameSet::load(const string& path) {
+	if (!filesystem::exists(path)) {
+		return;
+	}
+	ifstream in(path, ios::binary);
+	vector<uint64_t> buf(1 << 16);
+	while (in) {
+		in.read(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(uint64_t));
+		size_t n = in.gcount() / sizeof(uint64_t);
+		for (size_t i=0; i<n; i++) {
+			insert(buf[i]);
+		}
+	}
+	if (!in.eof()) {
+		throw runtime_error("Error reading game set " + path);
+	}
+}
+
+void GameSet::save(const string& path) {
+	// write next to the old file and rename, so an interrupted save keeps the old set
+	string tmp = path + ".tmp";
+	{
+		ofstream out(tmp, ios::binary | ios::trunc);
+		for (auto& shard: shards) {
+			lock_guard<mutex> lock(shard.mtx);
+			for (auto fp: shard.slots) {
+				if (fp != 0) out.write(reinterpret_cast<const char*>(&fp), sizeof(fp));
+			}
+		}
+		if (!out) {
+			throw runtime_error("Error writing game set " + tmp);
+		}
+	}
+	filesystem::rename(tmp, path);
+}
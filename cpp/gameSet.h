@@ -0,0 +1,37 @@
+#ifndef GAME_SET_H
+#define GAME_SET_H
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Stable 64-bit fingerprint of a game id or of a whole game's text. It doesn't depend
+// on the platform or the run, so fingerprints can be persisted.
+uint64_t gameFingerprint(std::string_view data);
+
+// A set of game fingerprints shared by all the parsers of a pool to drop games that
+// were already seen. Each shard is an open-addressing table of bare fingerprints, so a
+// game costs 8-16 bytes.
+class GameSet {
+public:
+	// true if fp wasn't in the set yet
+	bool insert(uint64_t fp);
+	size_t size();
+	// adds the fingerprints saved in path, if it exists
+	void load(const std::string& path);
+	void save(const std::string& path);
+private:
+	static const int SHARD_BITS = 6;
+	static const int N_SHARDS = 1 << SHARD_BITS;
+	struct Shard {
+		std::mutex mtx;
+		// 0 marks an empty slot, the size is a power of two and at most half of it is used
+		std::vector<uint64_t> slots;
+		size_t count = 0;
+	};
+	Shard shards[N_SHARDS];
+	static bool insertSlot(std::vector<uint64_t>& slots, uint64_t fp);
+};
+
+#endif
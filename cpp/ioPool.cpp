@@ -0,0 +1,57 @@
+#include <cerrno>
+#include <unistd.h>
+#include "ioPool.h"
+
+ssize_t preadFull(int fd, size_t offset, size_t size, char* buf) {
+	size_t total = 0;
+	while (total < size) {
+		ssize_t n = pread(fd, buf + total, size - total, offset + total);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) break;
+		total += n;
+	}
+	return total;
+}
+
+IoPool::IoPool(int nThreads) : stop(false) {
+	for (int i=0; i<nThreads; i++) {
+		threads.emplace_back([this] {
+			while (true) {
+				std::packaged_task<ssize_t()> task;
+				{
+					std::unique_lock<std::mutex> lock(mtx);
+					cv.wait(lock, [this]{ return stop || !tasks.empty(); });
+					if (stop && tasks.empty()) return;
+					task = std::move(tasks.front());
+					tasks.pop();
+				}
+				task();
+			}
+		});
+	}
+}
+
+IoPool::~IoPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	cv.notify_all();
+	for (auto& thread: threads) {
+		thread.join();
+	}
+}
+
+std::future<ssize_t> IoPool::read(int fd, size_t offset, size_t size, char* buf) {
+	std::packaged_task<ssize_t()> task([=]{ return preadFull(fd, offset, size, buf); });
+	auto result = task.get_future();
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		tasks.push(std::move(task));
+	}
+	cv.notify_one();
+	return result;
+}
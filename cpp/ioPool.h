@@ -0,0 +1,29 @@
+#ifndef IO_POOL_H
+#define IO_POOL_H
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+// Shared pool of threads that service positional reads for all DecompressStreams,
+// so that each stream can keep several compressed blocks in flight while it
+// decompresses the current one.
+class IoPool {
+public:
+	IoPool(int nThreads);
+	~IoPool();
+	std::future<ssize_t> read(int fd, size_t offset, size_t size, char* buf);
+private:
+	std::vector<std::thread> threads;
+	std::queue<std::packaged_task<ssize_t()> > tasks;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stop;
+};
+
+ssize_t preadFull(int fd, size_t offset, size_t size, char* buf);
+
+#endif
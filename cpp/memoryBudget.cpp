@@ -0,0 +1,57 @@
+#include "memoryBudget.h"
+
+MemoryBudget::MemoryBudget(size_t limit): limitBytes(limit), usedBytes(0), pressure(false) {}
+
+void MemoryBudget::setPressureHandler(std::function<void()> handler) {
+	onPressure = handler;
+}
+
+bool MemoryBudget::tryAcquire(size_t bytes, std::function<void()> resume) {
+	std::lock_guard<std::mutex> lock(mtx);
+	size_t cur = usedBytes.load();
+	while (limitBytes == 0 || cur == 0 || cur + bytes <= limitBytes) {
+		if (usedBytes.compare_exchange_weak(cur, cur + bytes)) return true;
+	}
+	// parked under mtx, which release takes after lowering usedBytes, so no wakeup is lost
+	waiters.push_back(std::move(resume));
+	if (!pressure.exchange(true) && onPressure) {
+		onPressure();
+	}
+	return false;
+}
+
+void MemoryBudget::charge(size_t bytes) {
+	usedBytes += bytes;
+}
+
+void MemoryBudget::release(size_t bytes) {
+	usedBytes -= bytes;
+	std::vector<std::function<void()> > resumed;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		resumed.swap(waiters);
+	}
+	for (auto& resume: resumed) {
+		resume();
+	}
+}
+
+void MemoryBudget::pressureRelieved() {
+	pressure = false;
+}
+
+bool MemoryBudget::underPressure() const {
+	return pressure;
+}
+
+size_t MemoryBudget::used() const {
+	return usedBytes;
+}
+
+size_t MemoryBudget::limit() const {
+	return limitBytes;
+}
+
+bool MemoryBudget::overLimit() const {
+	return limitBytes != 0 && usedBytes > limitBytes;
+}
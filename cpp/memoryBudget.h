@@ -0,0 +1,41 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Pool-wide account of the bytes held in game blocks, rows parsed but not handed to
+// the writer yet, unwritten bucket chunks and the row groups Parquet buffers.
+// Readers acquire before handing on a block and are parked while the budget is
+// spent; the writer charges what it buffers and is asked, through the pressure
+// handler, to flush buckets early when readers are parked.
+class MemoryBudget {
+public:
+	// limit 0 means unlimited
+	MemoryBudget(size_t limit);
+	// called, at most once until pressureRelieved, when a reader is parked
+	void setPressureHandler(std::function<void()> handler);
+	// takes bytes if they fit in the budget, or if nothing is held at all; otherwise
+	// returns false and calls resume once, after a later release, to try again
+	bool tryAcquire(size_t bytes, std::function<void()> resume);
+	// accounts bytes without waiting, for stages that must not block
+	void charge(size_t bytes);
+	void release(size_t bytes);
+	void pressureRelieved();
+	// whether readers are parked and the pressure handler has not been answered yet
+	bool underPressure() const;
+	size_t used() const;
+	size_t limit() const;
+	bool overLimit() const;
+private:
+	size_t limitBytes;
+	std::atomic<size_t> usedBytes;
+	std::atomic<bool> pressure;
+	std::function<void()> onPressure;
+	std::mutex mtx;
+	std::vector<std::function<void()> > waiters;
+};
+
+#endif
@@ -1,316 +1,444 @@
 #include "parallelParser.h"
+#include "batchBuilder.h"
+#include "board.h"
 #include "decompress.h"
 #include "parseMoves.h"
 #include "parser.h"
+#include "scan.h"
 #include "utils.h"
+#include <algorithm>
 #include <stdexcept>
 #include <chrono>
 #include <iostream>
-#include <unordered_set>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
 
-struct GameState {
-	std::queue<std::shared_ptr<GameDataBlock> >* gamesQ;
-	std::mutex* gamesMtx;
-	std::condition_variable* gamesCv;
+// what a block of games is charged to the memory budget, by the reader that fills it
+// and the task that parses it
+static size_t blockBytes(const GameBlock& block) {
+	return sizeof(GameBlock) + block.games.values.size() + sizeof(uint32_t)*block.size();
+}
+
+// A game belongs to the reader whose range contains the start of its [Event line.
+// Readers that don't start at the beginning of the file skip ahead to their first
+// [Event line, and a reader that runs out of range in the middle of a game keeps
+// reading past frameEnd until that game is finished, so every game is parsed
+// exactly once regardless of how the file is split. Readers only find game
+// boundaries; the games are handed on unparsed, in blocks of 100.
+struct RangeReader {
+	DecompressStream decompressor;
+	BlockFreeList<GameBlock>* blocks;
+	size_t frameEnd;
+	size_t fileEnd;
 	int pid;
-	GameState(
-			std::queue<std::shared_ptr<GameDataBlock> >* gamesQ, 
-			std::mutex* gamesMtx, 
-			std::condition_variable* gamesCv) 
-		: pid(-1), gamesQ(gamesQ), gamesMtx(gamesMtx), gamesCv(gamesCv) {};
+	bool extended;
+	bool finished;
+	// a slot among the blocks in flight is held for ready.front()
+	bool haveSlot;
+	std::vector<std::string_view> spans;
+	GameBlock* games;
+	std::deque<GameBlock*> ready;
+
+	RangeReader(std::string zst, size_t frameStart, size_t frameEnd, size_t fileEnd, int pid, size_t blockSize, std::shared_ptr<IoPool> ioPool, int queueDepth, BlockFreeList<GameBlock>* blocks)
+		: decompressor(zst, frameStart, frameEnd, blockSize, ioPool, queueDepth), blocks(blocks), frameEnd(frameEnd), fileEnd(fileEnd), pid(pid),
+		extended(false), finished(false), haveSlot(false), games(newBlock()) {};
+
+	GameBlock* newBlock() {
+		GameBlock* block = blocks->take();
+		block->pid = pid;
+		return block;
+	}
 
+	void addGame(std::string_view game) {
+		games->games.push(game);
+		games->progress = decompressor.getProgress();
+		if (games->size() == 100) {
+			ready.push_back(games);
+			games = newBlock();
+		}
+	}
 };
 
-void loadGamesZst(GameState gs, std::string zst, size_t frameStart, size_t frameEnd, int nMoveProcessors, int minSec, int maxSec, int maxInc) {
-	int gameId = 0;
-	int gamestart = 0;
-	int lineno = 0;
-	PgnProcessor processor(minSec, maxSec, maxInc);
-	DecompressStream decompressor(zst, frameStart, frameEnd);
-	auto games = std::make_shared<GameDataBlock>();
+struct ProcessorContext {
+	PgnProcessor processor;
+	// games are identified by their Site URL when they have one, by their text otherwise
+	size_t siteSlot;
+	bool replay;
+	ParsedMoves parsed;
+	std::vector<uint32_t> newlines;
+	Board board;
+	std::vector<uint16_t> codes;
+	std::vector<uint64_t> hashes;
+	std::string uci;
+	// slots of the partitioner's tags in processor
+	std::vector<size_t> partitionSlots;
+	// rows not handed to the sink yet, one builder per partition
+	int moveOutput;
+	bool numericAnnotations;
+	std::vector<std::string> extraTags;
+	std::unordered_map<size_t, std::unique_ptr<BatchBuilder> > outputs;
+	// the partitions with rows in outputs, so that flushing doesn't visit every partition seen
+	std::vector<size_t> filled;
+	size_t nOutput;
+	// the rows in outputs are charged to budget, if there is one, until the sink has them
+	MemoryBudget* budget;
+	size_t charged;
 
-	while(decompressor.decompressFrame() != 0) {
-		std::vector<std::string> lines;
-		decompressor.getLines(lines);
+	// the first extraTags.size() of tags are written
+	ProcessorContext(int minSec, int maxSec, int maxInc, int moveOutput, bool numericAnnotations, std::shared_ptr<const GameFilter> filter, const std::vector<std::string>& tags, const std::vector<std::string>& extraTags, size_t siteSlot, std::vector<size_t> partitionSlots, MemoryBudget* budget)
+		: processor(minSec, maxSec, maxInc, filter, tags), siteSlot(siteSlot), replay(moveOutput & (MOVES_CODES | MOVES_UCI | MOVES_HASHES)), partitionSlots(partitionSlots),
+		moveOutput(moveOutput), numericAnnotations(numericAnnotations), extraTags(extraTags), nOutput(0), budget(budget), charged(0) {
+		parsed.numericAnnotations = numericAnnotations;
+	};
 
-		for (auto line: lines) {
-			lineno++;
-			auto code = processor.processLine(line);
-			if (code == "COMPLETE") {
-				auto gd = std::make_shared<GameData>(
-					gs.pid,
-					decompressor.getProgress(),
-					gameId, 
-					processor.getWelo(), 
-					processor.getBelo(), 
-					processor.getTime(),
-					processor.getInc(),
-					processor.getWhite(),
-					processor.getBlack(),
-					processor.getMoveStr(),
-					zst + ":" + std::to_string(gamestart)
-				);
-				games->push_back(gd);
-				if (games->size() == 100) {
-					{
-						std::lock_guard<std::mutex> lock(*gs.gamesMtx);
-						gs.gamesQ->push(games);
-					}
-					gs.gamesCv->notify_one();
-					games = std::make_shared<GameDataBlock>();
-				}
-				gamestart = lineno + 1;
-				gameId++;
-			}
+	// the builder for a row of partition
+	BatchBuilder& output(size_t partition) {
+		auto& builder = outputs[partition];
+		if (!builder) {
+			builder = std::make_unique<BatchBuilder>(moveOutput, numericAnnotations, extraTags);
 		}
-	}	
-
-	if (games->size() > 0) {
-		{
-			std::lock_guard<std::mutex> lock(*gs.gamesMtx);
-			gs.gamesQ->push(games);
+		if (builder->size() == 0) {
+			filled.push_back(partition);
 		}
-		gs.gamesCv->notify_one();
-		games = std::make_shared<GameDataBlock>();
+		return *builder;
 	}
 
-	{
-		std::lock_guard<std::mutex> lock(*gs.gamesMtx);
-		games->push_back(std::make_shared<GameData>(gs.pid, "FILE_DONE", gameId));
-		for (int i=0; i<nMoveProcessors; i++) {
-			gs.gamesQ->push(games);
+	// charges what the builders grew by since the last call
+	void charge() {
+		if (!budget) {
+			return;
+		}
+		size_t held = 0;
+		for (auto partition: filled) {
+			held += outputs[partition]->bytes();
 		}
+		budget->charge(held - charged);
+		charged = held;
 	}
-	gs.gamesCv->notify_all();
-}
 
+	// finishes the largest partitions into rows until at most keep rows are left, so
+	// that rare partitions are handed on in few, large batches. Returns the bytes to
+	// release once the sink has taken the rows.
+	size_t finish(size_t keep, std::vector<PartitionRows>& rows) {
+		charge();
+		size_t handed = 0;
+		std::sort(filled.begin(), filled.end(), [this](size_t a, size_t b) {
+			return outputs[a]->size() > outputs[b]->size();
+		});
+		size_t n = 0;
+		while (nOutput > keep) {
+			size_t partition = filled[n++];
+			BatchBuilder& builder = *outputs[partition];
+			nOutput -= builder.size();
+			handed += builder.bytes();
+			auto batch = builder.finish();
+			if (!batch.ok()) {
+				throw std::runtime_error("Error building batch: " + batch.status().ToString());
+			}
+			rows.push_back({partition, *batch});
+		}
+		filled.erase(filled.begin(), filled.begin() + n);
+		if (!budget) {
+			return 0;
+		}
+		charged -= handed;
+		return handed;
+	}
+};
 
-std::vector<std::shared_ptr<std::thread> > startGamesReader(
-		std::queue<std::shared_ptr<GameDataBlock> >& gamesQ, 
-		std::mutex& gamesMtx,
-	   	std::condition_variable& gamesCv,
-		std::string zst,
-		std::vector<size_t>& frameBoundaries,
-	   	int nMoveProcessors, int minSec, int maxSec, int maxInc) {
-	GameState gs(&gamesQ, &gamesMtx, &gamesCv);
-	std::vector<std::shared_ptr<std::thread> > procs;
-	for (int i=0; i<frameBoundaries.size()-1; i++) {
-		size_t start = frameBoundaries[i];
-		size_t end = frameBoundaries[i+1];
-		gs.pid = i;
-		procs.push_back(
-				std::make_shared<std::thread>(
-					loadGamesZst, gs, zst, start, end, nMoveProcessors, minSec, maxSec, maxInc
-					)
-				);
+// Decompresses one compressed block of the range per task, so that readers of all
+// files take turns on the executor, and hands on the games read so far. A reader
+// that can't hand on a block parks until it can and is then resubmitted.
+void ParallelParser::readRange(std::shared_ptr<RangeReader> reader) {
+	if (!dispatchBlocks(reader)) {
+		return;
+	}
+	if (reader->finished) {
+		finishTask();
+		return;
+	}
+	DecompressStream& decompressor = reader->decompressor;
+	if (decompressor.decompressFrame() != 0) {
+		reader->spans.clear();
+		decompressor.getGames(reader->spans);
+		for (auto game: reader->spans) {
+			reader->addGame(game);
+		}
+	} else if (decompressor.pendingGame() && !reader->extended && reader->frameEnd < reader->fileEnd) {
+		decompressor.extend(reader->fileEnd);
+		reader->extended = true;
+	} else {
+		if (decompressor.pendingGame() && !decompressor.getRemainder().empty()) {
+			// the last game of the file
+			reader->addGame(decompressor.getRemainder());
+		}
+		if (reader->games->size() > 0) {
+			reader->ready.push_back(reader->games);
+		} else {
+			gameBlocks.give(reader->games);
+		}
+		reader->games = nullptr;
+		reader->finished = true;
 	}
-	return procs;
+	executor->submit([this, reader] { readRange(reader); });
 }
 
-struct ProcessorState {
-	std::queue<std::shared_ptr<GameDataBlock> >* gamesQ;
-	std::queue<std::shared_ptr<MoveDataBlock> >* outputQ;
-	int pid;
-	std::mutex* gamesMtx;
-	std::mutex* outputMtx;
-	std::condition_variable* gamesCv;
-	std::condition_variable* outputCv;
-	ProcessorState(
-			std::queue<std::shared_ptr<GameDataBlock> >* gamesQ, 
-			std::queue<std::shared_ptr<MoveDataBlock> >* outputQ, 
-			std::mutex* gamesMtx, 
-			std::mutex* outputMtx,
-		   	std::condition_variable* gamesCv,
-		   	std::condition_variable* outputCv) 
-		: gamesQ(gamesQ), 
-		outputQ(outputQ),
-	   	pid(-1),
-	   	gamesMtx(gamesMtx),
-	   	outputMtx(outputMtx),
-	   	gamesCv(gamesCv),
-	   	outputCv(outputCv) {};
-};
+// returns false if the reader was parked
+bool ParallelParser::dispatchBlocks(std::shared_ptr<RangeReader> reader) {
+	// resume may be called by whoever the reader waits for after a task has failed
+	// and parse has given up on the file, so it must not use this
+	auto resume = [this, executor = executor, reader] {
+		executor->submit([this, reader] { readRange(reader); });
+	};
+	while (!reader->ready.empty()) {
+		GameBlock* block = reader->ready.front();
+		if (!reader->haveSlot) {
+			// parked under parkMtx, which block tasks take after freeing a slot
+			std::lock_guard<std::mutex> lock(parkMtx);
+			if (nBlocksInFlight >= maxBlocksInFlight) {
+				parked.push_back(resume);
+				return false;
+			}
+			nBlocksInFlight++;
+			reader->haveSlot = true;
+		}
+		if (budget && !budget->tryAcquire(blockBytes(*block), resume)) {
+			handOnWaitingRows();
+			return false;
+		}
+		reader->haveSlot = false;
+		reader->ready.pop_front();
+		nTasksLeft++;
+		executor->submit([this, block] { processBlock(block); });
+	}
+	return true;
+}
 
-void processGames(ProcessorState ps, int nReaders) {		
-	int nReadersDone = 0;
-	std::unordered_set<int> readerPids;
-	int totalGames = 0;
-	while(true) {
-		std::shared_ptr<GameDataBlock> games;
-		{
-			std::unique_lock<std::mutex> lock(*ps.gamesMtx);
-			ps.gamesCv->wait(lock, [&]{return !ps.gamesQ->empty();});
-			games = ps.gamesQ->front();
-			if (games->back()->info == "FILE_DONE") {
-				if (!readerPids.contains(games->back()->pid)) {
-					readerPids.insert(games->back()->pid);
-					nReadersDone++;
-					totalGames += games->back()->gameId;
-					ps.gamesQ->pop();
+void ParallelParser::processBlock(GameBlock* block, size_t first) {
+	std::unique_ptr<ProcessorContext> ctx;
+	{
+		std::lock_guard<std::mutex> lock(contextMtx);
+		if (!contexts.empty()) {
+			ctx = std::move(contexts.back());
+			contexts.pop_back();
+		}
+	}
+	if (!ctx) {
+		size_t siteSlot = std::find(extraTags.begin(), extraTags.end(), "Site") - extraTags.begin();
+		std::vector<std::string> tags = extraTags;
+		if (seen && siteSlot == tags.size()) {
+			tags.push_back("Site");
+		}
+		std::vector<size_t> partitionSlots;
+		if (partitioner) {
+			for (auto& tag: partitioner->getTags()) {
+				size_t slot = std::find(tags.begin(), tags.end(), tag) - tags.begin();
+				if (slot == tags.size()) {
+					tags.push_back(tag);
 				}
-			} else {
-				ps.gamesQ->pop();
+				partitionSlots.push_back(slot);
 			}
-			lock.unlock();
 		}
-		auto moves = std::make_shared<MoveDataBlock>();
-		if (games->back()->info == "FILE_DONE") {
-			if (nReadersDone==nReaders) {
-				std::lock_guard<std::mutex> lock(*ps.outputMtx);
-				moves->push_back(std::make_shared<MoveData>(ps.pid, "DONE", totalGames));
-				ps.outputQ->push(moves);
-				ps.outputCv->notify_one();
-				break;
+		ctx = std::make_unique<ProcessorContext>(minSec, maxSec, maxInc, moveOutput, numericAnnotations, filter, tags, extraTags, siteSlot, partitionSlots, budget.get());
+	}
+	int64_t nValid = 0, nDuplicates = 0;
+	size_t next = block->size();
+	std::vector<PartitionRows> rows;
+	size_t handed = 0;
+	for (size_t g=first; g<block->size(); g++) {
+		std::string_view game = block->games.get(g);
+		ctx->newlines.clear();
+		findNewlines(game.data(), 0, game.size(), ctx->newlines);
+		// the last game of a file need not end with a newline
+		ctx->newlines.push_back(game.size());
+
+		LineStatus status = LineStatus::INCOMPLETE;
+		size_t lineStart = 0;
+		for (auto lineEnd: ctx->newlines) {
+			status = ctx->processor.processLine(game.substr(lineStart, lineEnd-lineStart));
+			if (status != LineStatus::INCOMPLETE) break;
+			lineStart = lineEnd + 1;
+		}
+		if (status != LineStatus::COMPLETE) {
+			continue;
+		}
+		if (seen) {
+			std::string_view id = ctx->processor.getTag(ctx->siteSlot);
+			if (id.find('/') == std::string_view::npos) {
+				id = game.substr(0, game.find_last_not_of(" \r\n") + 1);
 			}
-		} else {
-			for (auto gd: *games) {
-				try {
-					auto [mvs, clk, eval, result] = parseMoves(gd->moveStr);
-					moves->push_back(
-						std::make_shared<MoveData>(gd->pid, gd, mvs, clk, eval, result)
-					);
-				} catch(std::exception &e) {
-					moves->push_back(std::make_shared<MoveData>(gd->pid, "INVALID"));
-				}
+			if (!seen->insert(gameFingerprint(id))) {
+				nDuplicates++;
+				continue;
 			}
-			{
-				std::lock_guard<std::mutex> lock(*ps.outputMtx);
-				ps.outputQ->push(moves);
-				ps.outputCv->notify_one();
+		}
+		try {
+			parseMoves(ctx->processor.getMoveStr(), ctx->parsed);
+			ctx->codes.clear();
+			ctx->hashes.clear();
+			if (ctx->replay && !replaySan(ctx->parsed.mvs, ctx->board, ctx->codes, (moveOutput & MOVES_HASHES) ? &ctx->hashes : nullptr, hashPlies)) {
+				continue;
 			}
-		}	
+			ctx->uci.clear();
+			if (moveOutput & MOVES_UCI) {
+				for (auto code: ctx->codes) {
+					if (!ctx->uci.empty()) ctx->uci.push_back(' ');
+					appendUci(ctx->uci, code);
+				}
+			}
+		} catch(std::exception &e) {
+			continue;
+		}
+		size_t partition = partitioner ? partitioner->partitionOf(ctx->processor, ctx->partitionSlots) : 0;
+		BatchBuilder& output = ctx->output(partition);
+		auto appended = output.append(ctx->processor, ctx->parsed, ctx->codes, ctx->uci, ctx->hashes);
+		if (!appended.ok()) {
+			throw std::runtime_error("Error building batch: " + appended.ToString());
+		}
+		nValid++;
+		if (++ctx->nOutput == chunkSize) {
+			// handed to the sink once the context is given back, as the sink may park
+			// this task and resume it right away
+			handed = ctx->finish(chunkSize / 2, rows);
+			next = g + 1;
+			break;
+		}
+	}
+	ctx->charge();
+	{
+		std::lock_guard<std::mutex> lock(contextMtx);
+		contexts.push_back(std::move(ctx));
+	}
+	nValidGames += nValid;
+	nDuplicatesSeen += nDuplicates;
+	if (!rows.empty()) {
+		auto resume = [this, executor = executor, block, next] {
+			executor->submit([this, block, next] { processBlock(block, next); });
+		};
+		// the block keeps its slot while parked, so the readers stop too
+		bool queued = sink->queueBatch(rows, resume);
+		if (budget) {
+			budget->release(handed);
+		}
+		if (!queued) {
+			return;
+		}
+		if (next < block->size()) {
+			resume();
+			return;
+		}
+	}
+	ngames += block->size();
+	int pid = block->pid;
+	float progress = block->progress;
+	if (budget) {
+		budget->release(blockBytes(*block));
+	}
+	gameBlocks.give(block);
+
+	nBlocksInFlight--;
+	std::vector<std::function<void()> > resumed;
+	{
+		std::lock_guard<std::mutex> lock(parkMtx);
+		resumed.swap(parked);
+	}
+	for (auto& resume: resumed) {
+		resume();
 	}
+	printProgress(pid, progress);
+	finishTask();
 }
 
-std::vector<std::shared_ptr<std::thread> >  startProcessorThreads(
-		int nMoveProcessors,
-		int nReaders, 
-		std::queue<std::shared_ptr<GameDataBlock> >& gamesQ, 
-		std::queue<std::shared_ptr<MoveDataBlock> >& outputQ, 
-		std::mutex& gamesMtx, 
-		std::mutex& outputMtx,
-	   	std::condition_variable& gamesCv, 
-		std::condition_variable& outputCv) {
+// Rows wait in the contexts until a chunk is full, which needs blocks that a reader
+// parked on the budget can't hand on, so the reader hands the rows on to the sink,
+// where they can be flushed.
+void ParallelParser::handOnWaitingRows() {
+	std::vector<std::vector<PartitionRows> > rows;
+	size_t handed = 0;
+	{
+		// only the contexts no task is using
+		std::lock_guard<std::mutex> lock(contextMtx);
+		for (auto& ctx: contexts) {
+			if (ctx->nOutput > 0) {
+				rows.emplace_back();
+				handed += ctx->finish(0, rows.back());
+			}
+		}
+	}
+	for (auto& piece: rows) {
+		sink->queueBatch(piece, nullptr);
+	}
+	if (handed > 0) {
+		budget->release(handed);
+	}
+}
 
-	std::vector<std::shared_ptr<std::thread> > threads;
-	ProcessorState ps(&gamesQ, &outputQ, &gamesMtx, &outputMtx, &gamesCv, &outputCv);
-	for (int i=0; i<nMoveProcessors; i++) {
-		ps.pid = i;
-		threads.push_back(std::make_shared<std::thread>(processGames, ps, nReaders));
-	}	
-	return threads;
+void ParallelParser::finishTask() {
+	if (nTasksLeft.fetch_sub(1) == 1) {
+		executor->notify();
+	}
 }
 
-ParallelParser::ParallelParser(int nReaders, int nMoveProcessors, int minSec, int maxSec, int maxInc, std::shared_ptr<EloWriter> writer, size_t chunkSize) 
-	: nReaders(nReaders), nMoveProcessors(nMoveProcessors), minSec(minSec), maxSec(maxSec), maxInc(maxInc), writer(writer), chunkSize(chunkSize) {};
+ParallelParser::ParallelParser(std::shared_ptr<Executor> executor, int nReaders, int minSec, int maxSec, int maxInc, std::shared_ptr<BatchSink> sink, std::shared_ptr<Partitioner> partitioner, size_t chunkSize, size_t blockSize, int queueDepth, std::shared_ptr<IoPool> ioPool, int moveOutput, size_t hashPlies, bool numericAnnotations, std::shared_ptr<const GameFilter> filter, std::vector<std::string> extraTags, std::shared_ptr<GameSet> seen, std::shared_ptr<MemoryBudget> budget, size_t maxBlocksInFlight) 
+	: executor(executor), nReaders(nReaders), minSec(minSec), maxSec(maxSec), maxInc(maxInc), sink(sink), partitioner(partitioner), chunkSize(chunkSize), blockSize(blockSize), queueDepth(queueDepth), ioPool(ioPool), moveOutput(moveOutput), hashPlies(hashPlies), numericAnnotations(numericAnnotations), filter(filter), extraTags(extraTags), seen(seen), budget(budget), maxBlocksInFlight(maxBlocksInFlight), nBlocksInFlight(0), nTasksLeft(0), ngames(0), nDuplicatesSeen(0), nValidGames(0) {};
 
+ParallelParser::~ParallelParser() {}
 
-int64_t ParallelParser::parse(std::string zst, std::string name, int offset, int printFreq, std::mutex& print_mtx, std::vector<std::string>& info) {
-	int64_t ngames = 0;
-	int64_t nValidGames = 0;
-	std::vector<int64_t> nGamesLastUpdate(nReaders, 0);
-	int totalGames = INT_MAX;
-	int nFinished = 0;
-	
-	std::vector<size_t> frameBoundaries = getFrameBoundaries(zst, nReaders);
-	nReaders = frameBoundaries.size()-1;
 
-	procThreads = startProcessorThreads(
-		nMoveProcessors,
-		nReaders, 
-		gamesQ, 
-		outputQ, 
-		gamesMtx,
-		outputMtx,
-		gamesCv,
-		outputCv
-	);
+void ParallelParser::printProgress(int pid, float progress) {
+	std::unique_lock<std::mutex> lock(printMtx, std::try_to_lock);
+	if (!lock.owns_lock() || !ellapsedGTE(lastPrintTime[pid], printFreq)) {
+		return;
+	}
+	int64_t n = ngames;
+	int totalGamesEst = n / progress;
+	auto [eta, now] = getEta(totalGamesEst, n, start);
+	long ellapsed = std::chrono::duration_cast<milli>(now-lastPrintTime[pid]).count();
+	int gamesPerSec = 1000*(n-nGamesLastUpdate[pid])/ellapsed;
+	nGamesLastUpdate[pid] = n;
+	lastPrintTime[pid] = now;
 
-	gameThreads = startGamesReader(
-		gamesQ, 
-		gamesMtx, 
-		gamesCv, 
-		zst,
-		frameBoundaries,
-		nMoveProcessors,
-		minSec,
-		maxSec,
-		maxInc
-	);
+	std::string status = "\t" + fileName + "." + std::to_string(pid) + ": " + std::to_string(int(100*progress)) + \
+						"% done, games/sec: " + std::to_string(gamesPerSec) + ", eta: " + eta;
+	(*info)[infoOffset + pid + 1] = status;
+}
 
-	auto start = hrc::now();
-	auto lastPrintTime = std::vector<hrc::time_point>(nReaders, start);
-		
-	std::shared_ptr<ParsedData> output = std::make_shared<ParsedData>(chunkSize);
-	int curOutputNgames = 0;
+int64_t ParallelParser::parse(std::string zst, std::string name, int offset, int printFreq, std::vector<std::string>& info, int64_t& nDuplicates) {
+	std::vector<size_t> frameBoundaries = getFrameBoundaries(zst, nReaders);
+	nReaders = frameBoundaries.size()-1;
 
-	while (ngames < totalGames || nFinished < nMoveProcessors) {
-		std::shared_ptr<MoveDataBlock> moves;
-		{
-			std::unique_lock<std::mutex> lock(outputMtx);
-			outputCv.wait(lock, [&]{return !outputQ.empty();});
-			moves = outputQ.front();
-			outputQ.pop();
-			lock.unlock();
-		}
-		for (auto md: *moves) {
-			if (md->info == "DONE") {
-				totalGames = md->gameId;
-				nFinished++;
-			} else if (md->info == "ERROR") {
-				ngames++;
-			} else if (md->info == "INVALID") {
-				ngames++;
-			} else if (md->info == "GAME") {
-				output->welos[curOutputNgames] = md->welo;
-				output->belos[curOutputNgames] = md->belo;
-				output->whites[curOutputNgames] = md->white;
-				output->blacks[curOutputNgames] = md->black;
-				output->timeCtl[curOutputNgames] = md->time;
-				output->increment[curOutputNgames] = md->inc;
-				output->mvs[curOutputNgames] = md->mvs;
-				output->clk[curOutputNgames] = md->clk;
-				output->eval[curOutputNgames] = md->eval;
-				output->result[curOutputNgames] = md->result;
-				ngames++;
-				nValidGames++;
-				curOutputNgames++;
-		
-				if (curOutputNgames == chunkSize) {
-					writer->queueBatch(output);
-					output = std::make_shared<ParsedData>(chunkSize);
-					curOutputNgames = 0;
-				}
+	fileName = name;
+	infoOffset = offset;
+	this->printFreq = printFreq;
+	this->info = &info;
+	ngames = 0;
+	nDuplicatesSeen = 0;
+	nValidGames = 0;
+	nGamesLastUpdate.assign(nReaders, 0);
+	start = hrc::now();
+	lastPrintTime.assign(nReaders, start);
 
-				if (ellapsedGTE(lastPrintTime[md->pid], printFreq)) {
-					int totalGamesEst = ngames / md->progress;
-					auto [eta, now] = getEta(totalGamesEst, ngames, start);
-					long ellapsed = std::chrono::duration_cast<milli>(now-lastPrintTime[md->pid]).count();
-					int gamesPerSec = 1000*(ngames-nGamesLastUpdate[md->pid])/ellapsed;
-					nGamesLastUpdate[md->pid] = ngames;
-					lastPrintTime[md->pid] = now;
-					
-					std::string status = "\t" + name + "." + std::to_string(md->pid) + ": " + std::to_string(int(100*md->progress)) + \
-										"% done, games/sec: " + std::to_string(gamesPerSec) + ", eta: " + eta;
-					int thisOffset = offset + md->pid + 1;
-					{
-                        //std::lock_guard<std::mutex> lock(print_mtx);
-						info[thisOffset] = status;
-					}
-				}
-			} else {
-				throw std::runtime_error("invalid code: " + md->info);
-			}
-		}
-	}
-	if (curOutputNgames > 0) {
-		writer->queueBatch(output);
+	nTasksLeft = nReaders;
+	for (int i=0; i<nReaders; i++) {
+		auto reader = std::make_shared<RangeReader>(zst, frameBoundaries[i], frameBoundaries[i+1], frameBoundaries.back(), i, blockSize, ioPool, queueDepth, &gameBlocks);
+		executor->submit([this, reader] { readRange(reader); });
 	}
-	for (auto gt: gameThreads) {
-		gt->join();
+	executor->wait([this] { return nTasksLeft == 0; });
+	if (auto error = executor->failure()) {
+		std::rethrow_exception(error);
 	}
-	for (auto rt: procThreads) {
-		rt->join();
+	// every task is done, so all contexts are back and their partial chunks can go
+	for (auto& ctx: contexts) {
+		if (ctx->nOutput > 0) {
+			std::vector<PartitionRows> rows;
+			size_t handed = ctx->finish(0, rows);
+			sink->queueBatch(rows, nullptr);
+			if (budget) {
+				budget->release(handed);
+			}
+		}
 	}
+	nDuplicates = nDuplicatesSeen;
 	return nValidGames;
 }
@@ -1,85 +1,88 @@
 #include <queue>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <thread>
 #include <functional>
-#include "eloWriter.h"
+#include "batchSink.h"
+#include "executor.h"
+#include "gameBlock.h"
+#include "gameFilter.h"
+#include "gameSet.h"
+#include "partitioner.h"
+#include "ioPool.h"
+#include "memoryBudget.h"
 
-struct Data {
-	int pid;
-	float progress;
-	int gameId;
-	int welo;
-	int belo;
-	int time;
-	int inc;
-	std::string white;
-	std::string black;
-	std::string info; 
-
-	Data() {};
-	Data(int pid, std::string info): pid(pid), info(info) {};
-	Data(int pid, std::string info, int gameId): pid(pid), gameId(gameId), info(info) {};
-	Data(int pid, float progress, int gid, int welo, int belo, int time, int inc, std::string white, std::string black, std::string info)
-		: pid(pid), progress(progress), gameId(gid), welo(welo), belo(belo), time(time), inc(inc), white(white), black(black), info(info) {};
-	Data(int pid, std::shared_ptr<Data> other)
-		: pid(pid), progress(other->progress), gameId(other->gameId), welo(other->welo), belo(other->belo), time(other->time), inc(other->inc), white(other->white), black(other->black), info(other->info) {};
-};
-
-struct GameData: Data {
-	GameData(): Data() {};
-	GameData(int pid, std::string info) : Data(pid, info) {};
-	GameData(int pid, std::string info, int gameId): Data(pid, info, gameId) {};
-	GameData(int pid, float progress, int gid, int welo, int belo, int time, int inc, std::string white, std::string black, std::string moveStr, std::string info) 
-		: Data(pid, progress, gid, welo, belo, time, inc, white, black, info), moveStr(moveStr) {};
-
-	std::string moveStr;
-};
-
-struct MoveData: Data {
-	MoveData(int pid, std::string info) : Data(pid, info) {};
-	MoveData(int pid, std::string info, int gameId): Data(pid, info, gameId) {};
-	MoveData(
-			int pid, 
-			std::shared_ptr<GameData> gd, 
-			std::string mvs,
-			std::string clk,
-			std::string eval,
-			uint8_t result
-			) 
-		: Data(pid, gd), mvs(mvs), clk(clk), eval(eval), result(result) {
-		this->info = "GAME";
-	};
-
-	std::string mvs;
-	std::string clk;
-	std::string eval;
-	uint8_t result;
-};
-
-typedef std::vector<std::shared_ptr<GameData> > GameDataBlock;
-typedef std::vector<std::shared_ptr<MoveData> > MoveDataBlock;
+struct RangeReader;
+struct ProcessorContext;
 
+// Parses one file at a time. Reading a range of frames and parsing a block of games
+// are tasks on the executor shared by the whole pool. Block tasks fill chunks for the
+// sink themselves, so parse() only waits for the tasks and hands on what is left.
 class ParallelParser {
-	std::queue<std::shared_ptr<GameDataBlock> > gamesQ;
-	std::queue<std::shared_ptr<MoveDataBlock> > outputQ;
-	std::mutex gamesMtx;
-	std::mutex outputMtx;
-	std::condition_variable gamesCv;
-	std::condition_variable outputCv;
+	std::shared_ptr<Executor> executor;
+	BlockFreeList<GameBlock> gameBlocks;
 	int nReaders;
-	int nMoveProcessors;
 	int minSec;
 	int maxSec;
 	int maxInc;
-	std::vector<std::shared_ptr<std::thread> > procThreads;
-	std::vector<std::shared_ptr<std::thread> > gameThreads;
-	std::shared_ptr<EloWriter> writer;
+	std::shared_ptr<BatchSink> sink;
+	std::shared_ptr<Partitioner> partitioner;
 	size_t chunkSize;
+	size_t blockSize;
+	int queueDepth;
+	std::shared_ptr<IoPool> ioPool;
+	int moveOutput;
+	size_t hashPlies;
+	bool numericAnnotations;
+	std::shared_ptr<const GameFilter> filter;
+	std::vector<std::string> extraTags;
+	std::shared_ptr<GameSet> seen;
+	std::shared_ptr<MemoryBudget> budget;
+
+	// blocks read but not parsed yet; readers park when there are maxBlocksInFlight
+	size_t maxBlocksInFlight;
+	std::atomic<size_t> nBlocksInFlight;
+	std::mutex parkMtx;
+	std::vector<std::function<void()> > parked;
+	// reader and block tasks still running; the last one wakes parse()
+	std::atomic<int> nTasksLeft;
+	// counts for the current file
+	std::atomic<int64_t> ngames;
+	std::atomic<int64_t> nDuplicatesSeen;
+	std::atomic<int64_t> nValidGames;
+	// progress is printed by whichever block task gets printMtx, the others skip it
+	std::mutex printMtx;
+	std::string fileName;
+	int infoOffset;
+	int printFreq;
+	std::vector<std::string>* info;
+	std::vector<int64_t> nGamesLastUpdate;
+	std::chrono::high_resolution_clock::time_point start;
+	std::vector<std::chrono::high_resolution_clock::time_point> lastPrintTime;
+	// parsing state and a chunk being filled, reused by block tasks, one per task
+	// running at the same time
+	std::mutex contextMtx;
+	std::vector<std::unique_ptr<ProcessorContext> > contexts;
+
+	void readRange(std::shared_ptr<RangeReader> reader);
+	bool dispatchBlocks(std::shared_ptr<RangeReader> reader);
+	// parses the games of block from first on; parked if the sink is full, and then
+	// resubmitted to carry on with the next game
+	void processBlock(GameBlock* block, size_t first = 0);
+	void handOnWaitingRows();
+	void printProgress(int pid, float progress);
+	void finishTask();
 public:
-	ParallelParser(int nReaders, int nMoveProcessors, int minSec, int maxSec, int maxInc, std::shared_ptr<EloWriter> writer, size_t chunkSize);
-	int64_t parse(std::string zst, std::string name, int offset, int printFreq, std::mutex& print_mtx, std::vector<std::string>& info);
+	ParallelParser(std::shared_ptr<Executor> executor, int nReaders, int minSec, int maxSec, int maxInc, std::shared_ptr<BatchSink> sink, std::shared_ptr<Partitioner> partitioner, size_t chunkSize, size_t blockSize, int queueDepth, std::shared_ptr<IoPool> ioPool, int moveOutput, size_t hashPlies, bool numericAnnotations, std::shared_ptr<const GameFilter> filter, std::vector<std::string> extraTags, std::shared_ptr<GameSet> seen, std::shared_ptr<MemoryBudget> budget, size_t maxBlocksInFlight);
+	~ParallelParser();
+	// returns the number of games written; nDuplicates is set to the number of games
+	// dropped because seen already had them. Rethrows the first exception of a task on
+	// the executor, after which the executor and so the parser can't be used again.
+	int64_t parse(std::string zst, std::string name, int offset, int printFreq, std::vector<std::string>& info, int64_t& nDuplicates);
 };
@@ -1,101 +1,50 @@
 #include "parquetWriter.h"
-#include <filesystem>
+#include <arrow/util/byte_size.h>
 
-namespace fs = std::filesystem;
-
-ParquetWriter::ParquetWriter(std::string root_path): root_path(root_path) {
-    schema =
-		arrow::schema({arrow::field("moves", arrow::utf8()), 
-            arrow::field("clk", arrow::utf8()), 
-            arrow::field("eval", arrow::utf8()), 
-            arrow::field("result", arrow::int8()),
-            arrow::field("welo", arrow::int16()),
-            arrow::field("belo", arrow::int16()),
-            arrow::field("white", arrow::utf8()),
-            arrow::field("black", arrow::utf8()),
-            arrow::field("timeCtl", arrow::int16()), 
-            arrow::field("increment", arrow::int16())});
-
-    std::string fn = "data.parquet";
-    int i = 0;
-    while (fs::exists(root_path + "/" + fn)) {
-        fn = "data_" + std::to_string(i++) + ".parquet";
-    }
-    PARQUET_ASSIGN_OR_THROW(outfile, arrow::io::FileOutputStream::Open(root_path + "/" + fn));
+ParquetWriter::ParquetWriter(std::string path, std::shared_ptr<arrow::Schema> schema, int64_t row_group_bytes)
+    : schema(schema), row_group_bytes(row_group_bytes), n_rows(0), buffered_bytes(0), row_group_full(false), pool(arrow::default_memory_pool()) {
+    PARQUET_ASSIGN_OR_THROW(outfile, arrow::io::FileOutputStream::Open(path));
 
     parquet::WriterProperties::Builder builder;
     builder.compression(parquet::Compression::ZSTD);
+    builder.memory_pool(&pool);
     std::shared_ptr<parquet::WriterProperties> props = builder.build();
 
-    auto pool = arrow::default_memory_pool();
-    PARQUET_ASSIGN_OR_THROW(parquet_writer, parquet::arrow::FileWriter::Open(*schema, pool, outfile, props));
-
-    mv_builder = arrow::StringBuilder(pool); 	
-    clk_builder = arrow::StringBuilder(pool);	
-    eval_builder = arrow::StringBuilder(pool);	
-    welo_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);	
-    belo_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);	
-    white_builder = arrow::StringBuilder(pool);	
-    black_builder = arrow::StringBuilder(pool);	
-    timeCtl_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);	
-    increment_builder = arrow::NumericBuilder<arrow::Int16Type>(pool);	
-    result_builder = arrow::NumericBuilder<arrow::Int8Type>(pool);
+    PARQUET_ASSIGN_OR_THROW(parquet_writer, parquet::arrow::FileWriter::Open(*schema, &pool, outfile, props));
 }
 
-arrow::Result<std::string> ParquetWriter::write(std::shared_ptr<ParsedData> res, size_t size) {
-    mv_builder.Reset();
-    clk_builder.Reset();
-    welo_builder.Reset();
-    belo_builder.Reset();
-    white_builder.Reset();
-    black_builder.Reset();
-    timeCtl_builder.Reset();
-    increment_builder.Reset();
-    result_builder.Reset();
-    eval_builder.Reset();
-
-    for (size_t j=0; j<size; j++) {
-        ARROW_RETURN_NOT_OK(mv_builder.Append(res->mvs[j]));
-        ARROW_RETURN_NOT_OK(clk_builder.Append(res->clk[j]));
-        ARROW_RETURN_NOT_OK(eval_builder.Append(res->eval[j]));
-        ARROW_RETURN_NOT_OK(welo_builder.Append(res->welos[j]));
-        ARROW_RETURN_NOT_OK(belo_builder.Append(res->belos[j]));
-        ARROW_RETURN_NOT_OK(white_builder.Append(res->whites[j]));
-        ARROW_RETURN_NOT_OK(black_builder.Append(res->blacks[j]));
-        ARROW_RETURN_NOT_OK(timeCtl_builder.Append(res->timeCtl[j]));
-        ARROW_RETURN_NOT_OK(increment_builder.Append(res->increment[j]));
-        ARROW_RETURN_NOT_OK(result_builder.Append(res->result[j]));
+arrow::Status ParquetWriter::write(std::shared_ptr<arrow::RecordBatch> batch) {
+    if (row_group_full) {
+        ARROW_RETURN_NOT_OK(parquet_writer->NewBufferedRowGroup());
+        row_group_full = false;
+        buffered_bytes = 0;
     }
+    ARROW_RETURN_NOT_OK(parquet_writer->WriteRecordBatch(*batch));
+    n_rows += batch->num_rows();
+    // batches may be slices of a larger one
+    ARROW_ASSIGN_OR_RAISE(int64_t bytes, arrow::util::ReferencedBufferSize(*batch));
+    buffered_bytes += bytes;
+    row_group_full = row_group_bytes > 0 && buffered_bytes >= row_group_bytes;
+    return arrow::Status::OK();
+}
 
-    std::shared_ptr<arrow::Array> moves;
-    std::shared_ptr<arrow::Array> clk;
-    std::shared_ptr<arrow::Array> welos;
-    std::shared_ptr<arrow::Array> belos;
-    std::shared_ptr<arrow::Array> white;
-    std::shared_ptr<arrow::Array> black;
-    std::shared_ptr<arrow::Array> timeCtl;
-    std::shared_ptr<arrow::Array> increment;
-    std::shared_ptr<arrow::Array> result;
-    std::shared_ptr<arrow::Array> eval;
+int64_t ParquetWriter::rows() const {
+    return n_rows;
+}
 
-    ARROW_RETURN_NOT_OK(mv_builder.Finish(&moves));
-    ARROW_RETURN_NOT_OK(clk_builder.Finish(&clk));
-    ARROW_RETURN_NOT_OK(eval_builder.Finish(&eval));
-    ARROW_RETURN_NOT_OK(welo_builder.Finish(&welos));
-    ARROW_RETURN_NOT_OK(belo_builder.Finish(&belos));
-    ARROW_RETURN_NOT_OK(white_builder.Finish(&white));
-    ARROW_RETURN_NOT_OK(black_builder.Finish(&black));
-    ARROW_RETURN_NOT_OK(timeCtl_builder.Finish(&timeCtl));
-    ARROW_RETURN_NOT_OK(increment_builder.Finish(&increment));
-    ARROW_RETURN_NOT_OK(result_builder.Finish(&result));
+int64_t ParquetWriter::bytes() const {
+    return outfile->Tell().ValueOr(0);
+}
 
-    auto batch = arrow::RecordBatch::Make(schema, size, {moves, clk, eval, result, welos, belos, white, black, timeCtl, increment});
-    PARQUET_THROW_NOT_OK(parquet_writer->WriteRecordBatch(*batch));
+int64_t ParquetWriter::buffered() const {
+    return buffered_bytes;
+}
 
-    return root_path;
+int64_t ParquetWriter::memory() const {
+    return pool.bytes_allocated();
 }
 
 void ParquetWriter::close() {
     PARQUET_THROW_NOT_OK(parquet_writer->Close());
     PARQUET_THROW_NOT_OK(outfile->Close());
-}
\ No newline at end of file
+}
@@ -3,27 +3,38 @@
 #include <arrow/api.h>
 #include <arrow/io/file.h>
 #include <parquet/arrow/writer.h>
-#include "parser.h"
+#include <memory>
+#include <string>
 
+// Writes batches built by BatchBuilder to a new file at path. A row group is closed
+// once row_group_bytes of Arrow data are buffered for it, 0 leaving row groups to
+// Parquet's row count. It goes to the file with the next batch or on close, as
+// Parquet can't end a row group without starting the next one, and an empty one
+// would be left at the end of the file. So bytes() is behind by at most one row group.
 class ParquetWriter {
 public:
-    ParquetWriter(std::string root_path);
+    ParquetWriter(std::string path, std::shared_ptr<arrow::Schema> schema, int64_t row_group_bytes);
     void close();
-    arrow::Result<std::string> write(std::shared_ptr<ParsedData> res, size_t size);
+    arrow::Status write(std::shared_ptr<arrow::RecordBatch> batch);
+    int64_t rows() const;
+    // the size of the row groups written to the file so far
+    int64_t bytes() const;
+    // Arrow bytes of the rows in the row group not written to the file yet
+    int64_t buffered() const;
+    // bytes the writer holds in memory, mostly the encoded pages of the row group
+    // being buffered
+    int64_t memory() const;
 private:
-    std::string root_path;
     std::shared_ptr<arrow::Schema> schema;
+    int64_t row_group_bytes;
+    int64_t n_rows;
+    // Arrow bytes in the row group being buffered
+    int64_t buffered_bytes;
+    // the row group has row_group_bytes and the next batch starts a new one
+    bool row_group_full;
+    // counts what the Parquet writer allocates
+    arrow::ProxyMemoryPool pool;
     std::shared_ptr<arrow::io::FileOutputStream> outfile;
     std::unique_ptr<parquet::arrow::FileWriter> parquet_writer;
-    arrow::StringBuilder mv_builder;
-    arrow::StringBuilder clk_builder;
-    arrow::StringBuilder eval_builder;
-    arrow::StringBuilder white_builder;
-    arrow::StringBuilder black_builder;
-    arrow::NumericBuilder<arrow::Int16Type> welo_builder;
-    arrow::NumericBuilder<arrow::Int16Type> belo_builder;
-    arrow::NumericBuilder<arrow::Int16Type> timeCtl_builder;
-    arrow::NumericBuilder<arrow::Int16Type> increment_builder;
-    arrow::NumericBuilder<arrow::Int8Type> result_builder;
 };
 #endif
@@ -1,183 +1,304 @@
 #include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
 #include <vector>
 #include <string>
-#include <re2/re2.h>
-#include <tuple>
 #include "parseMoves.h"
 
 using namespace std;
 
-const string MV_PAT = "(O-O-O\\+?#?|O-O\\+?#?|[a-hRNBQK]+[0-9=x]*[a-hRNBQK]*[0-9]*[=RNBQ+#]*)\\??\\??\\!?";
-const string CLK_PAT = "(?:\\{ (?:\\[%eval ([0-9.\\-#]+)\\] )?(?:\\[%clk ([0-9:]+)\\] )?\\})?";
-const string ALT_LINE_PAT = "(?:\\([0-9]+\\.[0-9a-hRNBQK]*\\))?";
-const string NUM_PAT = "[0-9]+\\.";
-const string NUM_ALT_PAT = "(?:" + NUM_PAT + "\\.\\.)?";
-const string RESULT_PAT = ".*(1/2-1/2|0-1|1-0)";
-
-const re2::RE2 fullMovePat(NUM_PAT + " " + MV_PAT + " " + CLK_PAT + " ?" + NUM_ALT_PAT + " ?" + "(?:" + MV_PAT + ")? ?" + CLK_PAT);
-
-string nextMoveStr(string& moveStr, int& idx, int curmv) {
-	int mvstart = idx;
-	string nextmv = to_string(curmv+1) + ". ";
-
-	bool inParens = false;
-	bool inBracket = false;
-	while(idx < moveStr.size()) {
-		if (inParens) {
-			while (moveStr[idx] != ')') idx++;
-			inParens = false;
-		} else if (inBracket) {
-			while (moveStr[idx] != '}') idx++;
-			inBracket = false;
-		} else if (moveStr[idx] == '(') {
-			inParens = true;
-		} else if (moveStr[idx] == '{') {
-			inBracket = true;
-		} else if (moveStr.substr(idx, nextmv.size()) == nextmv) {
-			break;
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline void appendToken(string& dst, const char* src, size_t n) {
+	if (!dst.empty()) dst.push_back(' ');
+	dst.append(src, n);
+}
+
+// "[%clk h:mm:ss]" -> seconds; fractional seconds are dropped
+static int parseClock(const char* p, const char* end) {
+	int secs = 0;
+	int field = 0;
+	for (; p < end && *p != ']' && *p != '.'; p++) {
+		if (*p == ':') {
+			secs = secs*60 + field;
+			field = 0;
+		} else if (*p >= '0' && *p <= '9') {
+			field = field*10 + (*p - '0');
 		}
-		idx++;
-	}
-
-	string ss = moveStr.substr(mvstart, idx-mvstart);
-	return ss;
-}
-
-string clkToSec(string timeStr) {
-	int m = stoi(timeStr.substr(2, 2));
-	int s = stoi(timeStr.substr(5, 2));
-	return to_string(m * 60 + s);
-}
-
-tuple<string, string, string, int8_t> parseMoves(string moveStr) {
-	string mvs = "";
-	string clk = "";
-	string eval = "";
-	int8_t result;
-	int curmv = 1;
-	int idx = 0;
-	
-	while (idx < moveStr.size()) {
-		string ss = nextMoveStr(moveStr, idx, curmv);
-		string wm="", bm="", weval="", wclk="", beval="", bclk="";
-		re2::RE2::PartialMatch(ss, fullMovePat, &wm, &weval, &wclk, &bm, &beval, &bclk);
-
-		if (idx == moveStr.size()) {
-			string res;
-			re2::RE2::PartialMatch(moveStr.substr(idx-7,7), RESULT_PAT, &res);
-			if (res == "1/2-1/2") {
-				result = 2;
-			} else if (res == "0-1") {
-				result = 1;
+	}
+	return secs*60 + field;
+}
+
+static void appendClock(string& clk, int secs) {
+	char buf[16];
+	auto res = to_chars(buf, buf + sizeof(buf), secs);
+	appendToken(clk, buf, res.ptr - buf);
+}
+
+// "0.35", "-1.2" -> pawns; "#-3" -> NaN with mate = -3
+static void appendEval(ParsedMoves& out, string_view ev) {
+	if (!ev.empty() && ev[0] == '#') {
+		int mate = 0;
+		from_chars(ev.data() + 1 + (ev.size() > 1 && ev[1] == '+'), ev.data() + ev.size(), mate);
+		out.evals.push_back(NAN);
+		out.mates.push_back(mate);
+		return;
+	}
+	bool neg = !ev.empty() && ev[0] == '-';
+	float val = 0;
+	float scale = 0;
+	for (size_t i = neg || (!ev.empty() && ev[0] == '+'); i < ev.size(); i++) {
+		if (ev[i] == '.') {
+			scale = 1;
+		} else if (ev[i] >= '0' && ev[i] <= '9') {
+			val = val*10 + (ev[i] - '0');
+			scale *= 10;
+		}
+	}
+	if (scale > 1) val /= scale;
+	out.evals.push_back(neg ? -val : val);
+	out.mates.push_back(0);
+}
+
+// scans a {...} comment for %clk and %eval commands and returns the position after '}'
+static size_t scanComment(string_view s, size_t i, ParsedMoves& out) {
+	size_t n = s.size();
+	const char* base = s.data();
+	for (i++; i < n && s[i] != '}'; i++) {
+		if (s[i] != '%') continue;
+		if (s.compare(i+1, 4, "clk ") == 0) {
+			i += 5;
+			int secs = parseClock(base + i, base + n);
+			if (out.numericAnnotations) {
+				out.clkSecs.push_back(secs);
+			} else {
+				appendClock(out.clk, secs);
+			}
+		} else if (s.compare(i+1, 5, "eval ") == 0) {
+			i += 6;
+			size_t start = i;
+			while (i < n && s[i] != ']' && s[i] != ',' && s[i] != '}' && !isSpace(s[i])) i++;
+			if (out.numericAnnotations) {
+				appendEval(out, s.substr(start, i - start));
 			} else {
-				result = 0;
+				appendToken(out.eval, base + start, i - start);
 			}
+			i--;
 		}
+	}
+	return i + 1;
+}
 
-		if (wm == "") {
-			break;
-		} 
-		if (weval != "") {
-			eval += weval + " ";
-		}
-		if (wclk != "") {
-			clk += clkToSec(wclk) + " ";
+// skips a (possibly nested) variation, including any comments inside it
+static size_t skipVariation(string_view s, size_t i) {
+	size_t n = s.size();
+	int depth = 0;
+	for (; i < n; i++) {
+		if (s[i] == '{') {
+			while (i < n && s[i] != '}') i++;
+		} else if (s[i] == '(') {
+			depth++;
+		} else if (s[i] == ')') {
+			if (--depth == 0) return i + 1;
 		}
-		mvs += wm + " ";
+	}
+	return n;
+}
 
-		if (bclk != "") {
-			clk += clkToSec(bclk) + " ";
-		}
-		if (bm != "") {
-			mvs += bm + " ";
-		}
-		if (beval != "") {
-			eval += beval + " ";
+// Single pass over PGN movetext: SAN moves, move numbers, {comments} with %clk/%eval,
+// ;comments, $NAGs, (variations) and the game termination marker.
+void parseMoves(string_view s, ParsedMoves& out) {
+	out.clear();
+	size_t n = s.size();
+	size_t i = 0;
+	while (i < n) {
+		char c = s[i];
+		if (isSpace(c)) {
+			i++;
+		} else if (c == '{') {
+			i = scanComment(s, i, out);
+		} else if (c == '(') {
+			i = skipVariation(s, i);
+		} else if (c == ';') {
+			while (i < n && s[i] != '\n') i++;
+		} else if (c == '$') {
+			i++;
+			while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+		} else if (c == '*' || c == ')') {
+			i++;
+		} else if (c >= '0' && c <= '9') {
+			// move number ("12." or "12...") or result ("1-0", "0-1", "1/2-1/2")
+			size_t start = i;
+			while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+			if (i < n && (s[i] == '-' || s[i] == '/')) {
+				string_view res = s.substr(start, 7);
+				if (res == "1/2-1/2") {
+					out.result = 2;
+				} else if (res.substr(0, 3) == "0-1") {
+					out.result = 1;
+				} else {
+					out.result = 0;
+				}
+				while (i < n && !isSpace(s[i])) i++;
+			} else {
+				while (i < n && s[i] == '.') i++;
+			}
+		} else {
+			size_t start = i;
+			while (i < n && !isSpace(s[i]) && s[i] != '{' && s[i] != '(' && s[i] != '$') i++;
+			size_t end = i;
+			while (end > start && (s[end-1] == '!' || s[end-1] == '?')) end--;
+			if (end > start) {
+				appendToken(out.mvs, s.data() + start, end - start);
+				out.nMoves++;
+			}
 		}
-		curmv++;
 	}
-	return make_tuple(mvs.substr(0, mvs.size()-1), clk.substr(0, clk.size()-1), eval.substr(0, eval.size()-1), result);
+	if (out.nMoves == 0) {
+		throw runtime_error("no moves in movetext");
+	}
 }
 
-const string TERM_PATS[] = {
+const string_view TERM_PATS[] = {
 	"Normal",
 	"Time forfeit"
 };
 
-const re2::RE2 timeRe("\\[TimeControl \"([0-9]+)\\+*([0-9]+)\"\\]");
-const re2::RE2 termRe("\\[Termination \"(.+)\"\\]");
-const re2::RE2 reW("\\[WhiteElo \"([0-9]+)\"\\]");
-const re2::RE2 reB("\\[BlackElo \"([0-9]+)\"\\]");
-const re2::RE2 reWname("\\[White \"(.+)\"\\]");
-const re2::RE2 reBname("\\[Black \"(.+)\"\\]");
-
-string processRawLine(string& line, State& state, int minSec, int maxSec, int maxInc) {
-	line.erase(remove(line.begin(), line.end(), '\n'), line.cend());
-	if (line.size() > 0) {
-		if (line[0] == '[') {
-			if (line.substr(0, 6) == "[Event") {
-				state.init();
-			} else if (line.substr(0, 9) == "[WhiteElo") {
-				state.weloStr = line;
-			} else if (line.substr(0,9) == "[BlackElo") {
-				state.beloStr = line;
-			} else if (line.substr(0, 7) == "[White ") {
-				state.white = line;
-			} else if (line.substr(0, 7) == "[Black ") {
-				state.black = line;
-			} else if (line.substr(0,12) == "[TimeControl") {
-				int tim, inc = 0;
-				if (re2::RE2::PartialMatch(line, timeRe, &tim, &inc)) {
-					if (inc <= maxInc && tim <= maxSec && tim >= minSec) {
+static bool parseInt(string_view str, int& val) {
+	auto res = from_chars(str.data(), str.data() + str.size(), val);
+	return res.ec == errc() && res.ptr == str.data() + str.size();
+}
+
+// "<base>+<increment>" or "<base>"; "-" (correspondence) and "?" are rejected
+static bool parseTimeControl(string_view str, int& tim, int& inc) {
+	size_t plus = str.find('+');
+	inc = 0;
+	if (plus == string_view::npos) {
+		return parseInt(str, tim);
+	}
+	return parseInt(str.substr(0, plus), tim) && parseInt(str.substr(plus+1), inc);
+}
+
+// Tag pairs are dispatched on the length of the tag name and then compared in full,
+// so tags we don't use cost one switch and at most a couple of short compares.
+int TagSet::add(string_view tag) {
+	int i = slot(tag);
+	if (i >= 0) return i;
+	names.emplace_back(tag);
+	lengths |= uint64_t(1) << min<size_t>(tag.size(), 63);
+	return names.size() - 1;
+}
+
+int TagSet::slot(string_view tag) const {
+	if (!((lengths >> min<size_t>(tag.size(), 63)) & 1)) return -1;
+	for (size_t i=0; i<names.size(); i++) {
+		if (names[i] == tag) return i;
+	}
+	return -1;
+}
+
+size_t TagSet::size() const {
+	return names.size();
+}
+
+LineStatus processRawLine(string_view line, State& state, int minSec, int maxSec, int maxInc, const TagSet& tags) {
+	if (line.size() == 0) {
+		return LineStatus::INCOMPLETE;
+	}
+	if (line[0] == '[') {
+		size_t nameEnd = line.find(' ');
+		size_t valueStart = line.find('"');
+		size_t valueEnd = line.rfind('"');
+		if (nameEnd == string_view::npos || valueStart == string_view::npos || valueEnd <= valueStart) {
+			return LineStatus::INCOMPLETE;
+		}
+		string_view name = line.substr(1, nameEnd-1);
+		string_view value = line.substr(valueStart+1, valueEnd-valueStart-1);
+
+		switch (name.size()) {
+			case 5:
+				if (name == "Event") {
+					state.init();
+					state.started = true;
+				} else if (name == "White") {
+					state.white = value;
+				} else if (name == "Black") {
+					state.black = value;
+				}
+				break;
+			case 8:
+				if (name == "WhiteElo") {
+					state.haveWelo = parseInt(value, state.welo);
+				} else if (name == "BlackElo") {
+					state.haveBelo = parseInt(value, state.belo);
+				}
+				break;
+			case 11:
+				if (name[1] == 'i' && name == "TimeControl") {
+					int tim, inc;
+					if (parseTimeControl(value, tim, inc) && inc <= maxInc && tim <= maxSec && tim >= minSec) {
 						state.time = tim;
 						state.inc = inc;
+						state.haveTime = true;
 					}
-				}
-			} else if (line.substr(0, 12) == "[Termination") {
-				string term;
-				re2::RE2::PartialMatch(line, termRe, &term);
-				for (auto tp: TERM_PATS) {
-					if (term.find(tp) != string::npos) {
-						state.validTerm = true;
-						break;
+				} else if (name[1] == 'e' && name == "Termination") {
+					for (auto tp: TERM_PATS) {
+						if (value.find(tp) != string_view::npos) {
+							state.validTerm = true;
+							break;
+						}
 					}
 				}
-			}
-		} else if (line[0] == '1') {
-			if (state.time > 0 && state.weloStr != "" && state.beloStr != "") {
-				int welo, belo;
-				bool haveW = re2::RE2::PartialMatch(state.weloStr, reW, &welo);
-				bool haveB = re2::RE2::PartialMatch(state.beloStr, reB, &belo);
-				if (haveW && haveB) {
-					std::string white, black;
-					re2::RE2::PartialMatch(state.white, reWname, &white);
-					re2::RE2::PartialMatch(state.black, reBname, &black);
-					state.welo = welo;
-					state.belo = belo;
-					state.white = white;
-					state.black = black;
-					state.moveStr = line;
-					return "COMPLETE";
-				}
-			}
-			return "INVALID";
+				break;
 		}
+		int slot = tags.slot(name);
+		if (slot >= 0) {
+			state.tags[slot] = value;
+		}
+	} else if (line[0] == '1') {
+		if (state.haveTime && state.haveWelo && state.haveBelo) {
+			state.moveStr = line;
+			return LineStatus::COMPLETE;
+		}
+		return LineStatus::INVALID;
 	}
-	return "INCOMPLETE";
+	return LineStatus::INCOMPLETE;
 }
 
-PgnProcessor::PgnProcessor(int minSec, int maxSec, int maxInc): reinit(false), minSec(minSec), maxSec(maxSec), maxInc(maxInc) {}
+PgnProcessor::PgnProcessor(int minSec, int maxSec, int maxInc, shared_ptr<const GameFilter> filter, const vector<string>& extraTags): reinit(false), minSec(minSec), maxSec(maxSec), maxInc(maxInc), filter(filter) {
+	for (auto& tag: extraTags) {
+		this->tags.add(tag);
+	}
+	if (filter) {
+		for (auto& tag: filter->getTags()) {
+			this->filterSlots.push_back(this->tags.add(tag));
+		}
+		this->filterValues.resize(this->filterSlots.size());
+	}
+	this->state.tags.resize(this->tags.size());
+}
 
-string PgnProcessor::processLine(string& line) {
+LineStatus PgnProcessor::processLine(string_view line) {
 	if (this->reinit) {
 		this->state.init();
 		this->reinit = false;
 	}
-	string code = processRawLine(line, this->state, this->minSec, this->maxSec, this->maxInc);
-	if (code == "COMPLETE" || code == "INVALID") {
+	LineStatus status = processRawLine(line, this->state, this->minSec, this->maxSec, this->maxInc, this->tags);
+	if (status != LineStatus::INCOMPLETE) {
 		this->reinit = true;
 	}
-	return code;
+	if (status == LineStatus::COMPLETE && this->filter) {
+		for (size_t i=0; i<this->filterSlots.size(); i++) {
+			this->filterValues[i] = this->state.tags[this->filterSlots[i]];
+		}
+		if (!this->filter->matches(this->filterValues)) {
+			status = LineStatus::INVALID;
+		}
+	}
+	return status;
 }
 int PgnProcessor::getWelo() {
 	return this->state.welo;
@@ -185,13 +306,13 @@ int PgnProcessor::getWelo() {
 int PgnProcessor::getBelo() {
 	return this->state.belo;
 }
-string PgnProcessor::getWhite() {
+string_view PgnProcessor::getWhite() {
 	return this->state.white;
 }
-string PgnProcessor::getBlack() {
+string_view PgnProcessor::getBlack() {
 	return this->state.black;
 }
-string PgnProcessor::getMoveStr() {
+string_view PgnProcessor::getMoveStr() {
 	return this->state.moveStr;
 }
 int PgnProcessor::getTime() {
@@ -200,3 +321,6 @@ int PgnProcessor::getTime() {
 int PgnProcessor::getInc() {
 	return this->state.inc;
 }
+string_view PgnProcessor::getTag(size_t i) {
+	return this->state.tags[i];
+}
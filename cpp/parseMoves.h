@@ -1,47 +1,122 @@
+#ifndef PARSE_MOVES_H
+#define PARSE_MOVES_H
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <tuple>
+#include "gameFilter.h"
+
+enum class LineStatus : uint8_t {
+	INCOMPLETE,
+	COMPLETE,
+	INVALID
+};
 
 struct State {
-	std::string weloStr;
-	std::string beloStr;
 	int welo;
-	std::string white;
-	std::string black;
 	int belo;
 	int time;
 	int inc;
+	bool haveWelo;
+	bool haveBelo;
+	bool haveTime;
 	bool validTerm;
-	std::string moveStr;
-	State(): weloStr(""), beloStr(""), welo(0), belo(0), time(0), inc(0), validTerm(false), moveStr("") {};
+	bool started;
+	// views into the lines passed to processRawLine
+	std::string_view white;
+	std::string_view black;
+	std::string_view moveStr;
+	// values of the tags in the processor's TagSet, indexed by slot
+	std::vector<std::string_view> tags;
+	State() { init(); };
 	void init() {
-		this->weloStr = "";
-		this->beloStr = "";
 		this->welo = 0;
 		this->belo = 0;
 		this->time = 0;
+		this->inc = 0;
+		this->haveWelo = false;
+		this->haveBelo = false;
+		this->haveTime = false;
 		this->validTerm = false;
-		this->moveStr = "";
+		this->started = false;
+		this->white = std::string_view();
+		this->black = std::string_view();
+		this->moveStr = std::string_view();
+		std::fill(this->tags.begin(), this->tags.end(), std::string_view());
 	};
 };
 
-std::tuple<std::string, std::string, std::string, int8_t> parseMoves(std::string moveStr);
+// Output buffers for parseMoves. They are cleared, not freed, between games so
+// a processor can reuse one instance without reallocating.
+struct ParsedMoves {
+	std::string mvs;
+	std::string clk;
+	std::string eval;
+	int8_t result;
+	int nMoves;
+	// fill clkSecs, evals and mates instead of clk and eval
+	bool numericAnnotations = false;
+	std::vector<int32_t> clkSecs;
+	// in pawns; NaN where the eval is a mate score
+	std::vector<float> evals;
+	// moves to mate (negative if black mates), only meaningful where evals is NaN
+	std::vector<int16_t> mates;
+	void clear() {
+		mvs.clear();
+		clk.clear();
+		eval.clear();
+		clkSecs.clear();
+		evals.clear();
+		mates.clear();
+		result = 0;
+		nMoves = 0;
+	}
+};
+
+void parseMoves(std::string_view moveStr, ParsedMoves& out);
+
+// Header tags recorded into State::tags on top of the ones State always parses.
+class TagSet {
+public:
+	// the tag's slot, adding it if it isn't in the set yet
+	int add(std::string_view tag);
+	// -1 if the tag isn't in the set; tags of a length nobody asked for are rejected
+	// without comparing names
+	int slot(std::string_view tag) const;
+	size_t size() const;
+private:
+	std::vector<std::string> names;
+	uint64_t lengths = 0;
+};
 
 class PgnProcessor {
 public:
-	PgnProcessor(int minSec, int maxSec, int maxInc);
-	std::string processLine(std::string& line);
+	// games that don't match filter are INVALID; nullptr keeps everything.
+	// The values of extraTags are available through getTag.
+	PgnProcessor(int minSec, int maxSec, int maxInc, std::shared_ptr<const GameFilter> filter = nullptr, const std::vector<std::string>& extraTags = {});
+	LineStatus processLine(std::string_view line);
 	int getWelo();
 	int getBelo();
-	std::string getWhite();
-	std::string getBlack();
-	std::string getMoveStr();
+	std::string_view getWhite();
+	std::string_view getBlack();
+	// view into the line passed to the last processLine call
+	std::string_view getMoveStr();
 	int getTime();
 	int getInc();
+	// value of extraTags[i], empty if the game doesn't have it
+	std::string_view getTag(size_t i);
 private:
 	State state;
 	bool reinit;
 	int minSec;
 	int maxSec;
 	int maxInc;
+	std::shared_ptr<const GameFilter> filter;
+	TagSet tags;
+	// slot of each of the filter's tags, and their values for the current game
+	std::vector<int> filterSlots;
+	std::vector<std::string_view> filterValues;
 };
+#endif
@@ -1,32 +1,15 @@
 #ifndef PARSER_H 
 #define PARSER_H
-#include <vector>
-#include <string>
+#include <cstdint>
 
-struct ParsedData {
-	std::vector<int16_t> welos;
-	std::vector<int16_t> belos;
-	std::vector<std::string> whites;
-	std::vector<std::string> blacks;
-	std::vector<int16_t> timeCtl;
-	std::vector<int16_t> increment;
-	std::vector<int64_t> gamestarts;
-	std::vector<std::string> mvs;
-	std::vector<int8_t> result;
-	std::vector<std::string> clk;
-	std::vector<std::string> eval;
-	ParsedData(int chunkSize) {
-		welos.resize(chunkSize);
-		belos.resize(chunkSize);
-		whites.resize(chunkSize);
-		blacks.resize(chunkSize);
-		timeCtl.resize(chunkSize);
-		increment.resize(chunkSize);
-		gamestarts.resize(chunkSize);
-		mvs.resize(chunkSize);
-		result.resize(chunkSize);
-		clk.resize(chunkSize);
-		eval.resize(chunkSize);
-	}
+// Bit flags selecting the move columns that are written. MOVES_CODES, MOVES_UCI and
+// MOVES_HASHES replay every game on a board, and games with illegal moves are dropped.
+enum MoveOutput {
+	MOVES_SAN = 1,
+	MOVES_CODES = 2,
+	MOVES_UCI = 4,
+	// Zobrist hash of the position after each ply
+	MOVES_HASHES = 8
 };
+
 #endif
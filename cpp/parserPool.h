@@ -1,5 +1,6 @@
 #ifndef PARSER_POOL_H
 #define PARSER_POOL_H
+#include <algorithm>
 #include <condition_variable>
 #include <functional>
 #include <chrono>
@@ -8,14 +9,17 @@
 #include <queue>
 #include <thread>
 #include "parallelParser.h"
-#include "eloWriter.h"
+#include "batchBuilder.h"
+#include "batchStream.h"
+#include "partitionWriter.h"
 #include "utils.h"
+#include <arrow/c/bridge.h>
 
 class ParserPool {
 public:
     ParserPool(
         int nReaders,
-        int nMoveProcessors,
+        size_t nWorkers,
         int minSec,
         int maxSec,
         int maxInc,
@@ -23,37 +27,113 @@ public:
         std::vector<int> elo_edges,
         size_t chunkSize,
         int printFreq,
-        size_t numThreads
+        size_t numThreads,
+        size_t blockSize,
+        int queueDepth,
+        int moveOutput,
+        size_t hashPlies,
+        bool numericAnnotations,
+        std::string filter,
+        std::vector<std::string> extraTags,
+        bool dedup,
+        std::string dedupPath,
+        size_t gamesQueueSize,
+        size_t batchQueueSize,
+        size_t maxMemory,
+        size_t nWriters,
+        bool stream,
+        std::vector<std::string> partitionBy,
+        int64_t maxFileRows,
+        int64_t maxFileBytes,
+        size_t maxOpenFiles
     )
-        : stop_(false), curProcess(0), info(numThreads*(2+nReaders))
+        : dedupPath(dedupPath), stop_(false), exported(false), nRunning(numThreads), curProcess(0), info(numThreads*(2+nReaders))
     {
         assert(nReaders >= 1);
-        assert(nMoveProcessors >= 1);
         assert(minSec >= 0);
         assert(maxSec >= minSec);
         assert(maxInc >= 0);
         assert(chunkSize >= 1);
         assert(printFreq >= 1);
-        assert(outdir != "");
+        assert(blockSize >= 1);
+        assert(queueDepth >= 0);
+        assert(gamesQueueSize >= 1 && batchQueueSize >= 1);
+        assert(maxFileRows >= 0 && maxFileBytes >= 0);
+        assert(moveOutput > 0 && moveOutput <= (MOVES_SAN | MOVES_CODES | MOVES_UCI | MOVES_HASHES));
+        assert(stream || outdir != "");
         assert(elo_edges.size() > 0);
         for (size_t i = 1; i < elo_edges.size(); i++) {
             assert(elo_edges[i] > elo_edges[i-1]);
         }
+        for (size_t i = 0; i < extraTags.size(); i++) {
+            assert(extraTags[i] != "" && extraTags[i].find_first_of(" \"]") == std::string::npos);
+            assert(std::find(extraTags.begin(), extraTags.begin() + i, extraTags[i]) == extraTags.begin() + i);
+        }
+
+        // compiled once here so a malformed expression fails before any thread starts
+        std::shared_ptr<const GameFilter> gameFilter;
+        if (filter != "") {
+            gameFilter = std::make_shared<const GameFilter>(filter);
+        }
+        std::shared_ptr<Partitioner> partitioner;
+        if (!stream) {
+            partitioner = std::make_shared<Partitioner>(partitionBy, elo_edges);
+        }
+
+        if (dedup) {
+            seen = std::make_shared<GameSet>();
+            if (dedupPath != "") {
+                seen->load(dedupPath);
+            }
+        }
+
+        // shared by all files in flight, so the pool as a whole stays within maxMemory
+        if (maxMemory > 0) {
+            budget = std::make_shared<MemoryBudget>(maxMemory);
+        }
 
-        int eloChunkSize = 1024;
-		writer = std::make_shared<EloWriter>(outdir, elo_edges, eloChunkSize);
+        // reading, parsing and writing for all files run as tasks on one set of workers
+        executor = std::make_shared<Executor>(nWorkers);
+
+        auto schema = BatchBuilder::makeSchema(moveOutput, numericAnnotations, extraTags);
+        if (stream) {
+            this->stream = std::make_shared<BatchStream>(schema, batchQueueSize);
+            sink = this->stream;
+        } else {
+            int eloChunkSize = 1024;
+            sink = std::make_shared<PartitionWriter>(executor.get(), outdir, partitioner, eloChunkSize, maxFileRows, maxFileBytes, schema, batchQueueSize, budget, nWriters, maxOpenFiles);
+        }
+        if (budget) {
+            auto s = sink.get();
+            budget->setPressureHandler([s] { s->requestFlush(); });
+        }
+        if (queueDepth > 0) {
+            ioPool = std::make_shared<IoPool>(std::min<size_t>(64, numThreads*nReaders*queueDepth));
+        }
         threads_.reserve(numThreads);
         for (size_t procId = 0; procId < numThreads; ++procId) {
             threads_.emplace_back([=, this] {
                 int thisProc;
                 ParallelParser parser(
+                    executor,
                     nReaders,
-                    nMoveProcessors,
                     minSec,
                     maxSec,
                     maxInc,
-                    writer,
-                    chunkSize
+                    sink,
+                    partitioner,
+                    chunkSize,
+                    blockSize,
+                    queueDepth,
+                    ioPool,
+                    moveOutput,
+                    hashPlies,
+                    numericAnnotations,
+                    gameFilter,
+                    extraTags,
+                    seen,
+                    budget,
+                    gamesQueueSize
                 );
                 while (true) {
                     std::string zst;
@@ -64,7 +144,7 @@ public:
                             return !tasks_.empty() || stop_;
                         });
                         if (stop_ && tasks_.empty()) {
-                            return;
+                            break;
                         }
                         std::tie(zst, name) = tasks_.front();
                         tasks_.pop();
@@ -72,68 +152,162 @@ public:
                     }
                     auto start = std::chrono::high_resolution_clock::now();
                     auto offset = procId * (2+nReaders);
-                    {
-                        //std::lock_guard<std::mutex> lock(print_mutex_);
-                        info[offset] = std::to_string(thisProc) + ": parsing " + name + "...";
+                    info[offset] = std::to_string(thisProc) + ": parsing " + name + "...";
+                    int64_t nDuplicates;
+                    int64_t ngames;
+                    try {
+                        ngames = parser.parse(zst, name, offset, printFreq, info, nDuplicates);
+                    } catch (...) {
+                        // the other parsers stop too, as the executor drops their tasks
+                        fail(std::current_exception());
+                        break;
                     }
-                    auto ngames = parser.parse(zst, name, offset, printFreq, print_mutex_, info);
                     auto stop = std::chrono::high_resolution_clock::now();
+                    info[offset] = std::to_string(thisProc) + ": finished parsing " + std::to_string(ngames) + " games from " + name + " in " + getEllapsedStr(start, stop);
+                    if (seen) {
+                        info[offset] += ", dropped " + std::to_string(nDuplicates) + " duplicates";
+                    }
+                    for (int i = 1; i <= nReaders; i++) {
+                        info[i + offset] = "";
+                    }
                     {
-                        //std::lock_guard<std::mutex> lock(print_mutex_);
-                        info[offset] = std::to_string(thisProc) + ": finished parsing " + std::to_string(ngames) + " games from " + name + " in " + getEllapsedStr(start, stop);
-                        for (int i = 1; i <= nReaders; i++) {
-                            info[i + offset] = "";
-                        }
+                        // parsers finish files concurrently
+                        std::lock_guard<std::mutex> lock(queue_mutex_);
                         completed.push_back(name);
-			            counts.push_back(ngames);
+                        counts.push_back(ngames);
+                        duplicates.push_back(nDuplicates);
+                    }
+                }
+                // the last parser to finish ends the output
+                if (--nRunning == 0) {
+                    try {
+                        if (this->stream && error) {
+                            this->stream->fail(describe(error));
+                        }
+                        sink->close();
+                    } catch (...) {
+                        fail(std::current_exception());
                     }
                 }
             });
         }
     }
 
+    // waits for every file to be written, or in stream mode read, unless the stream
+    // was never taken, in which case the games are dropped. Rethrows the first error
+    // of any file, after which the output is incomplete.
     void join() {
-        stop_ = true;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            stop_ = true;
+            if (stream && !exported) {
+                stream->abandon();
+            }
+        }
         cv_.notify_all();
         for (auto& thread : threads_) {
             thread.join();
         }
-        writer->close();
+        executor.reset();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (seen && dedupPath != "") {
+            seen->save(dedupPath);
+        }
     }
 
     void enqueue(std::string zst, std::string name)
     {
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (stop_) {
+                throw std::runtime_error("The pool no longer accepts files");
+            }
             tasks_.emplace(zst, name);
         }
         cv_.notify_one();
     }
 
+    // stops accepting files and exports the games of the files enqueued so far as a
+    // stream that ends once they are all parsed; only in stream mode
+    void exportStream(struct ArrowArrayStream* out) {
+        if (!stream) {
+            throw std::runtime_error("The pool was not created in stream mode");
+        }
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (exported) {
+                throw std::runtime_error("The stream can only be read once");
+            }
+            if (stop_) {
+                throw std::runtime_error("The pool was joined before its stream was read");
+            }
+            stop_ = true;
+            exported = true;
+        }
+        cv_.notify_all();
+        auto status = arrow::ExportRecordBatchReader(stream->reader(), out);
+        if (!status.ok()) {
+            throw std::runtime_error("Error exporting stream: " + status.ToString());
+        }
+    }
+
     std::vector<std::string> getCompleted() {
-        //std::unique_lock<std::mutex> lock(print_mutex_);
+        std::lock_guard<std::mutex> lock(queue_mutex_);
         return completed;
     }
     std::vector<int64_t> getNGames() {
-        //std::unique_lock<std::mutex> lock(print_mutex_);
-    	return counts;
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        return counts;
+    }
+    std::vector<int64_t> getNDuplicates() {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        return duplicates;
     }
     std::vector<std::string> getInfo() {
-        //std::unique_lock<std::mutex> lock(print_mutex_);
     	return info;
     }        
 private:
-    std::shared_ptr<EloWriter> writer;
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!error) {
+            error = e;
+        }
+    }
+
+    static std::string describe(std::exception_ptr e) {
+        try {
+            std::rethrow_exception(e);
+        } catch (std::exception& ex) {
+            return ex.what();
+        } catch (...) {
+            return "unknown error";
+        }
+    }
+
+    std::shared_ptr<BatchSink> sink;
+    // set in stream mode, as sink
+    std::shared_ptr<BatchStream> stream;
+    std::shared_ptr<Executor> executor;
+    std::shared_ptr<IoPool> ioPool;
+    std::shared_ptr<GameSet> seen;
+    std::shared_ptr<MemoryBudget> budget;
+    std::string dedupPath;
     std::vector<std::thread> threads_;
     std::queue<std::pair<std::string, std::string> > tasks_;
     std::mutex queue_mutex_;
-    std::mutex print_mutex_;
     std::condition_variable cv_;
     bool stop_;
+    bool exported;
+    std::atomic<size_t> nRunning;
     int curProcess;
     std::vector<std::string> completed;
     std::vector<int64_t> counts;
+    std::vector<int64_t> duplicates;
     std::vector<std::string> info;
+    // the first exception of any parser
+    std::exception_ptr error;
 };
 
 #endif
@@ -0,0 +1,310 @@
+#include "partitionWriter.h"
+#include <algorithm>
+#include <arrow/util/byte_size.h>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+// Arrow bytes per row group when rolling by size; files are checked for size between
+// row groups, so this bounds how far past max_file_bytes they go
+static const int64_t ROW_GROUP_BYTES = 128 << 20;
+
+// batches with fewer rows are joined with their neighbours before they are written
+static const int64_t MIN_WRITE_ROWS = 256;
+
+// a pressure flush leaves smaller buckets alone where it can, so that it doesn't cut
+// the output into many small files
+static const size_t MIN_FLUSH_BYTES = 8 << 20;
+
+PartitionWriter::PartitionWriter(Executor* executor, std::string output_dir, std::shared_ptr<Partitioner> partitioner, int64_t chunk_size, int64_t max_file_rows, int64_t max_file_bytes, std::shared_ptr<arrow::Schema> schema, size_t queue_size, std::shared_ptr<MemoryBudget> budget, size_t n_shards, size_t max_open_files):
+    executor(executor),
+    output_dir(output_dir),
+    partitioner(partitioner),
+    chunk_size(chunk_size),
+    max_file_rows(max_file_rows),
+    max_file_bytes(max_file_bytes),
+    schema(schema),
+    max_open_files(max_open_files),
+    n_open(0),
+    budget(budget) {
+
+    fs::create_directories(output_dir);
+
+    if (n_shards == 0) {
+        n_shards = executor->size();
+    }
+    if (max_open_files > 0) {
+        n_shards = std::min(n_shards, max_open_files);
+    }
+    n_shards = std::max<size_t>(1, n_shards);
+    for (size_t k = 0; k < n_shards; ++k) {
+        shards.push_back(std::make_unique<Shard>(queue_size));
+    }
+}
+
+// partitions are dealt out in turn, so that neighbouring Elo buckets, which are the
+// busiest together, land on different shards
+size_t PartitionWriter::shardOf(size_t partition) const {
+    return partition % shards.size();
+}
+
+void PartitionWriter::close() {
+    if (executor->failure()) {
+        // a drain may have stopped halfway and still hold its shard
+        return;
+    }
+    for (auto& shard: shards) {
+        Backoff backoff;
+        while (shard->nPending > 0 || shard->draining) {
+            if (!shard->draining.exchange(true)) {
+                drain(*shard);
+            } else {
+                backoff.wait();
+            }
+        }
+    }
+
+    for (auto& shard: shards) {
+        for (auto& [partition, bucket]: shard->buckets) {
+            if (bucket.n_rows > 0) {
+                writeBucket(*shard, partition, bucket);
+            }
+        }
+        while (!shard->open.empty()) {
+            closeFile(*shard, shard->buckets[shard->open.front()]);
+        }
+    }
+}
+
+bool PartitionWriter::queueBatch(const std::vector<PartitionRows>& rows, std::function<void()>) {
+    std::vector<ShardBatch> parts(shards.size());
+    for (auto& piece: rows) {
+        parts[shardOf(piece.partition)].pieces.push_back(piece);
+    }
+    for (size_t k = 0; k < shards.size(); ++k) {
+        if (!parts[k].pieces.empty()) {
+            push(*shards[k], StageMsg<ShardBatch>(std::make_shared<ShardBatch>(std::move(parts[k]))));
+        }
+    }
+    return true;
+}
+
+void PartitionWriter::push(Shard& shard, StageMsg<ShardBatch> msg) {
+    Backoff backoff;
+    while (!shard.batchQ.tryPush(msg)) {
+        // write batches here rather than wait for a worker to do it
+        if (!shard.draining.exchange(true)) {
+            drain(shard);
+        } else {
+            backoff.wait();
+        }
+    }
+    shard.nPending++;
+    scheduleDrain(shard);
+}
+
+void PartitionWriter::requestFlush() {
+    for (auto& shard: shards) {
+        auto msg = StageMsg<ShardBatch>::flush();
+        if (!shard->batchQ.tryPush(msg)) {
+            // the drain is busy and checks the budget after every batch
+            continue;
+        }
+        shard->nPending++;
+        scheduleDrain(*shard);
+    }
+}
+
+// Every message gets a task after it is counted. A task that finds a drain running
+// leaves the message to it: the drain checks nPending once it is done, and if the
+// count hasn't caught up yet, the task that comes with the count will drain.
+void PartitionWriter::scheduleDrain(Shard& shard) {
+    executor->submit([this, &shard] {
+        if (!shard.draining.exchange(true)) {
+            drain(shard);
+        }
+    });
+}
+
+// must be called with shard.draining set
+void PartitionWriter::drain(Shard& shard) {
+    do {
+        StageMsg<ShardBatch> msg;
+        while (shard.batchQ.tryPop(msg)) {
+            if (msg.kind == StageMsg<ShardBatch>::FLUSH) {
+                flushBuckets(shard);
+            } else {
+                writeBatch(shard, *msg.block);
+            }
+            shard.nPending--;
+        }
+        shard.draining = false;
+    } while (shard.nPending > 0 && !shard.draining.exchange(true));
+}
+
+void PartitionWriter::openFile(Shard& shard, size_t partition, Bucket& bucket) {
+    // the partitions closed start a new file if they get more rows
+    while (max_open_files > 0 && n_open >= max_open_files && !shard.open.empty()) {
+        closeFile(shard, shard.buckets[shard.open.back()]);
+    }
+    fs::path dir = fs::path(output_dir) / partitioner->path(partition);
+    if (bucket.n_files == 0) {
+        fs::create_directories(dir);
+    }
+    // files of earlier runs are kept
+    fs::path file;
+    do {
+        file = dir / ("part-" + std::to_string(bucket.n_files++) + ".parquet");
+    } while (fs::exists(file));
+    bucket.writer = std::make_unique<ParquetWriter>(file.string(), schema, max_file_bytes > 0 ? std::min(max_file_bytes, ROW_GROUP_BYTES) : 0);
+    shard.open.push_front(partition);
+    bucket.open_pos = shard.open.begin();
+    n_open++;
+}
+
+void PartitionWriter::closeFile(Shard& shard, Bucket& bucket) {
+    bucket.writer->close();
+    bucket.writer.reset();
+    shard.open.erase(bucket.open_pos);
+    n_open--;
+    if (budget) {
+        budget->release(bucket.writer_bytes);
+    }
+    bucket.writer_bytes = 0;
+}
+
+void PartitionWriter::chargeWriter(Bucket& bucket) {
+    if (!budget || !bucket.writer) {
+        return;
+    }
+    // the buffers an open file keeps between row groups are left to max_open_files, as
+    // only closing the file frees them
+    size_t bytes = bucket.writer->buffered() > 0 ? std::max<int64_t>(0, bucket.writer->memory()) : 0;
+    if (bytes > bucket.writer_bytes) {
+        budget->charge(bytes - bucket.writer_bytes);
+    } else {
+        budget->release(bucket.writer_bytes - bytes);
+    }
+    bucket.writer_bytes = bytes;
+}
+
+void PartitionWriter::writeBucket(Shard& shard, size_t partition, Bucket& bucket) {
+    if (bucket.writer) {
+        shard.open.splice(shard.open.begin(), shard.open, bucket.open_pos);
+    }
+    // Batches go to the file one by one, so they aren't copied before they are encoded.
+    // Parquet has a high cost per batch though, so runs of small ones are joined first.
+    std::vector<std::shared_ptr<arrow::RecordBatch>> run;
+    int64_t run_rows = 0;
+    for (size_t i = 0; i < bucket.data.size(); ++i) {
+        auto& batch = bucket.data[i];
+        if (batch->num_rows() < MIN_WRITE_ROWS) {
+            run.push_back(batch);
+            run_rows += batch->num_rows();
+            if (run_rows < MIN_WRITE_ROWS && i + 1 < bucket.data.size()) {
+                continue;
+            }
+        }
+        if (!run.empty()) {
+            auto joined = run.size() > 1 ? arrow::ConcatenateRecordBatches(run) : run[0];
+            if (!joined.ok()) {
+                throw std::runtime_error("Error writing table: " + joined.status().ToString());
+            }
+            writeRows(shard, partition, bucket, *joined);
+            run.clear();
+            run_rows = 0;
+        }
+        if (batch->num_rows() >= MIN_WRITE_ROWS) {
+            writeRows(shard, partition, bucket, batch);
+        }
+    }
+    chargeWriter(bucket);
+    bucket.data.clear();
+    bucket.n_rows = 0;
+    if (budget) {
+        budget->release(bucket.n_bytes);
+    }
+    bucket.n_bytes = 0;
+}
+
+void PartitionWriter::writeRows(Shard& shard, size_t partition, Bucket& bucket, const std::shared_ptr<arrow::RecordBatch>& rows) {
+    // files roll over exactly at max_file_rows, and at the first row group past max_file_bytes
+    int64_t offset = 0;
+    while (offset < rows->num_rows()) {
+        if (!bucket.writer) {
+            openFile(shard, partition, bucket);
+        }
+        int64_t n = rows->num_rows() - offset;
+        if (max_file_rows > 0) {
+            n = std::min(n, max_file_rows - bucket.writer->rows());
+        }
+        auto status = bucket.writer->write(n == rows->num_rows() ? rows : rows->Slice(offset, n));
+        if (!status.ok()) {
+            throw std::runtime_error("Error writing table: " + status.ToString());
+        }
+        offset += n;
+        if ((max_file_rows > 0 && bucket.writer->rows() >= max_file_rows) || (max_file_bytes > 0 && bucket.writer->bytes() >= max_file_bytes)) {
+            closeFile(shard, bucket);
+        }
+    }
+}
+
+void PartitionWriter::flushBuckets(Shard& shard) {
+    if (!budget) {
+        return;
+    }
+    // before any release, so that readers parked again ask for another flush
+    budget->pressureRelieved();
+    // small buckets stay unless the shard holds more than its share of half the budget,
+    // which may be all that keeps parked readers from going on
+    size_t share = budget->limit() / 2 / shards.size();
+    size_t held = 0;
+    for (auto& [partition, bucket]: shard.buckets) {
+        held += bucket.n_bytes + bucket.writer_bytes;
+    }
+    while (held > 0 && budget->used() > budget->limit() / 2) {
+        auto largest = shard.buckets.end();
+        size_t largestBytes = 0;
+        for (auto it = shard.buckets.begin(); it != shard.buckets.end(); ++it) {
+            size_t bytes = it->second.n_bytes + it->second.writer_bytes;
+            if (bytes > largestBytes) {
+                largest = it;
+                largestBytes = bytes;
+            }
+        }
+        if (largestBytes < MIN_FLUSH_BYTES && held <= share) {
+            break;
+        }
+        // The bucket goes as a whole, rows and file: Parquet keeps a file's row group
+        // in memory until the file is closed or the next one starts, and starting one
+        // here would cut open files into small row groups.
+        Bucket& bucket = largest->second;
+        if (bucket.n_rows > 0) {
+            writeBucket(shard, largest->first, bucket);
+        }
+        if (bucket.writer) {
+            closeFile(shard, bucket);
+        }
+        held -= largestBytes;
+    }
+}
+
+void PartitionWriter::writeBatch(Shard& shard, const ShardBatch& part) {
+    for (auto& piece: part.pieces) {
+        Bucket& bucket = shard.buckets[piece.partition];
+        bucket.data.push_back(piece.rows);
+        bucket.n_rows += piece.rows->num_rows();
+        if (budget) {
+            size_t bytes = arrow::util::TotalBufferSize(*piece.rows);
+            budget->charge(bytes);
+            bucket.n_bytes += bytes;
+        }
+        if (bucket.n_rows >= chunk_size) {
+            writeBucket(shard, piece.partition, bucket);
+        }
+    }
+    if (budget && (budget->overLimit() || budget->underPressure())) {
+        flushBuckets(shard);
+    }
+}
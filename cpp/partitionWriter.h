@@ -0,0 +1,100 @@
+#ifndef PARTITION_WRITER_H
+#define PARTITION_WRITER_H
+
+#include "batchSink.h"
+#include "boundedQueue.h"
+#include "executor.h"
+#include "memoryBudget.h"
+#include "parquetWriter.h"
+#include "partitioner.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Writes each partition of partitioner to its own directory under output_dir, rolling
+// over to a new file once max_file_rows rows or max_file_bytes bytes are written (0
+// for no limit), and keeping at most max_open_files files open (0 for no limit) by
+// finishing the least recently written ones. The partitions are split among shards,
+// each with its own queue. The shards share max_open_files: a shard at the limit
+// finishes its own least recently written file, and one with no file open opens one
+// anyway, so the limit can be passed by fewer than n_shards files until the shards
+// holding more open their next file.
+// Callers hand in rows already split by partition, and each shard is written by drain
+// tasks on the executor, one at a time per shard, so the partitions need no locking
+// while different shards encode and compress concurrently. A partition's batches are
+// written once it has chunk_size rows.
+class PartitionWriter: public BatchSink {
+public:
+    // executor must outlive close(); n_shards 0 means one per executor worker. Once a
+    // task on the executor has failed, close leaves the files as they are
+    PartitionWriter(Executor* executor, std::string output_dir, std::shared_ptr<Partitioner> partitioner, int64_t chunk_size, int64_t max_file_rows, int64_t max_file_bytes, std::shared_ptr<arrow::Schema> schema, size_t queue_size, std::shared_ptr<MemoryBudget> budget, size_t n_shards, size_t max_open_files);
+    void close() override;
+    // never parks the caller: while queue_size batches are waiting for a shard, the
+    // caller drains it itself
+    bool queueBatch(const std::vector<PartitionRows>& rows, std::function<void()> resume) override;
+    // asks every shard to flush partitions early
+    void requestFlush() override;
+private:
+    // the pieces of a queueBatch call that belong to one shard
+    struct ShardBatch {
+        std::vector<PartitionRows> pieces;
+    };
+    struct Bucket {
+        // batches waiting to be written
+        std::vector<std::shared_ptr<arrow::RecordBatch>> data;
+        int64_t n_rows = 0;
+        // bytes charged to the budget for the unwritten rows
+        size_t n_bytes = 0;
+        // the file being filled, if any, and its place in the shard's open files
+        std::unique_ptr<ParquetWriter> writer;
+        // bytes charged to the budget for the row group writer holds in memory
+        size_t writer_bytes = 0;
+        std::list<size_t>::iterator open_pos;
+        // number of the next file
+        int n_files = 0;
+    };
+    struct Shard {
+        BoundedQueue<StageMsg<ShardBatch>> batchQ;
+        // messages pushed and not written yet; counted after the push, so briefly negative
+        std::atomic<int64_t> nPending;
+        // set while a drain runs
+        std::atomic<bool> draining;
+        // the shard's partitions that got rows, by number
+        std::unordered_map<size_t, Bucket> buckets;
+        // partitions with an open file, the most recently written first
+        std::list<size_t> open;
+        Shard(size_t queue_size): batchQ(queue_size), nPending(0), draining(false) {};
+    };
+    Executor* executor;
+    std::string output_dir;
+    std::shared_ptr<Partitioner> partitioner;
+    int64_t chunk_size;
+    int64_t max_file_rows;
+    int64_t max_file_bytes;
+    std::shared_ptr<arrow::Schema> schema;
+    // 0 for no limit
+    size_t max_open_files;
+    // open files of all shards
+    std::atomic<size_t> n_open;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::shared_ptr<MemoryBudget> budget;
+    size_t shardOf(size_t partition) const;
+    void push(Shard& shard, StageMsg<ShardBatch> msg);
+    void scheduleDrain(Shard& shard);
+    void drain(Shard& shard);
+    void writeBatch(Shard& shard, const ShardBatch& part);
+    // writes the shard's largest buckets out as short chunks and closes their files,
+    // until the budget is back to half or the buckets left are small
+    void flushBuckets(Shard& shard);
+    void writeBucket(Shard& shard, size_t partition, Bucket& bucket);
+    void writeRows(Shard& shard, size_t partition, Bucket& bucket, const std::shared_ptr<arrow::RecordBatch>& rows);
+    void openFile(Shard& shard, size_t partition, Bucket& bucket);
+    void closeFile(Shard& shard, Bucket& bucket);
+    // brings the budget's charge for the bucket's writer up to date
+    void chargeWriter(Bucket& bucket);
+};
+
+#endif
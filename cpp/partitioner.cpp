@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <stdexcept>
+#include "partitioner.h"
+
+using namespace std;
+
+static const char* const SPEEDS[] = {"ultrabullet", "bullet", "blitz", "rapid", "classical"};
+static const char* const DEFAULT_PARTITION = "__HIVE_DEFAULT_PARTITION__";
+
+// escapes the characters Hive escapes in partition values
+static string escapeValue(string_view value) {
+	if (value.empty()) {
+		return DEFAULT_PARTITION;
+	}
+	static const char* const hex = "0123456789ABCDEF";
+	string escaped;
+	for (char c: value) {
+		unsigned char u = c;
+		if (u < 0x20 || u == 0x7f || string_view("\"#%'*/:=?\\{[]^").find(c) != string_view::npos) {
+			escaped += '%';
+			escaped += hex[u >> 4];
+			escaped += hex[u & 15];
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+// yyyy.mm of a PGN date, empty if the year or month is unknown
+static string_view monthOf(string_view date) {
+	if (date.size() < 7 || date[4] != '.') {
+		return string_view();
+	}
+	for (size_t i: {0, 1, 2, 3, 5, 6}) {
+		if (!isdigit((unsigned char)date[i])) {
+			return string_view();
+		}
+	}
+	return date.substr(0, 7);
+}
+
+Partitioner::Partitioner(vector<string> keys, vector<int> eloEdges): eloEdges(eloEdges), dynamic(false) {
+	if (keys.empty()) {
+		throw runtime_error("no partition keys");
+	}
+	auto addTag = [this](const string& tag) {
+		size_t i = find(tags.begin(), tags.end(), tag) - tags.begin();
+		if (i == tags.size()) {
+			tags.push_back(tag);
+		}
+		return i;
+	};
+	for (auto& name: keys) {
+		if (count(keys.begin(), keys.end(), name) > 1) {
+			throw runtime_error("partition key \"" + name + "\" is repeated");
+		}
+		if (name == "welo" || name == "belo") {
+			if (eloEdges.empty()) {
+				throw runtime_error("partitioning by " + name + " needs Elo edges");
+			}
+			// named apart from the welo and belo columns, which hold the ratings
+			this->keys.push_back({name == "welo" ? WELO : BELO, name + "_bucket", eloEdges.size() + 1, 0});
+		} else if (name == "tc") {
+			this->keys.push_back({TC, name, size(SPEEDS), 0});
+		} else if (name == "month") {
+			size_t tag = addTag("UTCDate");
+			addTag("Date");
+			this->keys.push_back({MONTH, name, 0, tag});
+			dynamic = true;
+		} else {
+			if (name.empty() || name.find_first_of(" \"]=/") != string::npos) {
+				throw runtime_error("invalid partition key \"" + name + "\"");
+			}
+			this->keys.push_back({TAG, name, 0, addTag(name)});
+			dynamic = true;
+		}
+	}
+}
+
+const vector<string>& Partitioner::getTags() const {
+	return tags;
+}
+
+size_t Partitioner::digit(const Key& key, PgnProcessor& processor) const {
+	switch (key.type) {
+	case WELO:
+		return upper_bound(eloEdges.begin(), eloEdges.end(), processor.getWelo()) - eloEdges.begin();
+	case BELO:
+		return upper_bound(eloEdges.begin(), eloEdges.end(), processor.getBelo()) - eloEdges.begin();
+	default: {
+		int estimate = processor.getTime() + 40 * processor.getInc();
+		return estimate < 30 ? 0 : estimate < 180 ? 1 : estimate < 480 ? 2 : estimate < 1500 ? 3 : 4;
+	}
+	}
+}
+
+string_view Partitioner::value(const Key& key, PgnProcessor& processor, const vector<size_t>& tagSlots) const {
+	if (key.type == TAG) {
+		return processor.getTag(tagSlots[key.tag]);
+	}
+	string_view month = monthOf(processor.getTag(tagSlots[key.tag]));
+	if (month.empty()) {
+		// Date follows UTCDate in tags
+		month = monthOf(processor.getTag(tagSlots[key.tag + 1]));
+	}
+	return month;
+}
+
+string Partitioner::label(const Key& key, size_t digit) const {
+	if (key.type == TC) {
+		return SPEEDS[digit];
+	}
+	if (digit == eloEdges.size()) {
+		return to_string(eloEdges.back()) + "+";
+	}
+	return to_string(eloEdges[digit]);
+}
+
+size_t Partitioner::partitionOf(PgnProcessor& processor, const vector<size_t>& tagSlots) {
+	size_t fixed = 0;
+	for (auto& key: keys) {
+		if (key.radix > 0) {
+			fixed = fixed * key.radix + digit(key, processor);
+		}
+	}
+	if (!dynamic) {
+		return fixed;
+	}
+	thread_local string id;
+	id.assign(reinterpret_cast<const char*>(&fixed), sizeof(fixed));
+	for (auto& key: keys) {
+		if (key.radix == 0) {
+			id += value(key, processor, tagSlots);
+			id.push_back('\0');
+		}
+	}
+	{
+		shared_lock<shared_mutex> lock(mtx);
+		auto it = ids.find(id);
+		if (it != ids.end()) {
+			return it->second;
+		}
+	}
+	unique_lock<shared_mutex> lock(mtx);
+	auto [it, inserted] = ids.emplace(id, paths.size());
+	if (inserted) {
+		string path;
+		for (auto& key: keys) {
+			if (!path.empty()) {
+				path += '/';
+			}
+			path += key.name + "=";
+			if (key.radix > 0) {
+				path += label(key, digit(key, processor));
+			} else if (key.type == MONTH) {
+				string month = escapeValue(value(key, processor, tagSlots));
+				replace(month.begin(), month.end(), '.', '-');
+				path += month;
+			} else {
+				path += escapeValue(value(key, processor, tagSlots));
+			}
+		}
+		paths.push_back(path);
+	}
+	return it->second;
+}
+
+string Partitioner::path(size_t p) {
+	if (dynamic) {
+		shared_lock<shared_mutex> lock(mtx);
+		return paths[p];
+	}
+	string path;
+	for (size_t k = keys.size(); k-- > 0; ) {
+		path = keys[k].name + "=" + label(keys[k], p % keys[k].radix) + (path.empty() ? "" : "/") + path;
+		p /= keys[k].radix;
+	}
+	return path;
+}
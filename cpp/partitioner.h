@@ -0,0 +1,66 @@
+#ifndef PARTITIONER_H
+#define PARTITIONER_H
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "parseMoves.h"
+
+// Splits games into the partitions of a Hive-style dataset, one directory level per
+// key in the order given, e.g. welo_bucket=1600/belo_bucket=1800/tc=blitz. The keys are
+//
+//   welo, belo  the player's Elo bucket, in welo_bucket and belo_bucket directories,
+//               named after its upper edge in eloEdges, except for the last one,
+//               named "<last edge>+"
+//   tc          the lichess speed of time + 40 * increment: ultrabullet, bullet,
+//               blitz, rapid or classical
+//   month       yyyy-mm of UTCDate, or of Date without one
+//
+// and any other key is the name of a header tag whose value is the partition. Games
+// without a month or the tag go to __HIVE_DEFAULT_PARTITION__. Partitions of welo,
+// belo and tc alone are numbered up front, the others as they are first seen.
+class Partitioner {
+public:
+	// throws std::runtime_error for an invalid or repeated key
+	Partitioner(std::vector<std::string> keys, std::vector<int> eloEdges);
+	// the header tags partitionOf reads
+	const std::vector<std::string>& getTags() const;
+	// the partition of the game processor holds; tagSlots[i] is the slot of
+	// getTags()[i] in the processor
+	size_t partitionOf(PgnProcessor& processor, const std::vector<size_t>& tagSlots);
+	// the directory of partition p, relative to the root of the dataset
+	std::string path(size_t p);
+private:
+	enum KeyType : uint8_t {
+		WELO,
+		BELO,
+		TC,
+		MONTH,
+		TAG
+	};
+	struct Key {
+		KeyType type;
+		// of the directories
+		std::string name;
+		// number of values of a key numbered up front, 0 for the others
+		size_t radix;
+		// index in tags of the tag read, UTCDate for MONTH
+		size_t tag;
+	};
+	std::vector<Key> keys;
+	std::vector<int> eloEdges;
+	std::vector<std::string> tags;
+	bool dynamic;
+	// partitions seen so far when dynamic, by their values
+	std::shared_mutex mtx;
+	std::unordered_map<std::string, size_t> ids;
+	std::vector<std::string> paths;
+
+	size_t digit(const Key& key, PgnProcessor& processor) const;
+	std::string_view value(const Key& key, PgnProcessor& processor, const std::vector<size_t>& tagSlots) const;
+	std::string label(const Key& key, size_t digit) const;
+};
+
+#endif
@@ -1,29 +1,59 @@
 # distutils: language = c++
 # cython: language_level=3
 
+from libc.stdint cimport int64_t, uintptr_t
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 
+cdef extern from "reframe.h":
+    int64_t reframeZst(string src, string dst, size_t frameSize, int level) except + nogil
+
+cdef extern from "arrow/c/abi.h":
+    cdef struct ArrowArrayStream:
+        pass
+
 cdef extern from "parserPool.h":
     cdef cppclass ParserPool:
-        ParserPool(int nReaders, int nMoveProcessors, int minSec, int maxSec, int maxInc,
+        ParserPool(int nReaders, size_t nWorkers, int minSec, int maxSec, int maxInc,
                   string outdir, vector[int] elo_edges, size_t chunkSize, int printFreq,
-                  size_t numThreads) except +
-        void join()
-        void enqueue(string zst, string name)
+                  size_t numThreads, size_t blockSize, int queueDepth, int moveOutput,
+                  size_t hashPlies, bint numericAnnotations, string filter,
+                  vector[string] extraTags, bint dedup, string dedupPath,
+                  size_t gamesQueueSize, size_t batchQueueSize,
+                  size_t maxMemory, size_t nWriters, bint stream,
+                  vector[string] partitionBy, int64_t maxFileRows,
+                  int64_t maxFileBytes, size_t maxOpenFiles) except +
+        void join() except + nogil
+        void enqueue(string zst, string name) except +
+        void exportStream(ArrowArrayStream* out) except +
         vector[string] getCompleted()
         vector[long] getNGames()
+        vector[long] getNDuplicates()
         vector[string] getInfo()
 
 cdef class PyParserPool:
     cdef ParserPool* _pool
 
-    def __cinit__(self, int nReaders, int nMoveProcessors, int minSec, int maxSec, int maxInc,
+    def __cinit__(self, int nReaders, size_t nWorkers, int minSec, int maxSec, int maxInc,
                   str outdir, vector[int] elo_edges, size_t chunkSize, int printFreq,
-                  size_t numThreads):
-        self._pool = new ParserPool(nReaders, nMoveProcessors, minSec, maxSec, maxInc,
+                  size_t numThreads, size_t blockSize, int queueDepth, int moveOutput,
+                  size_t hashPlies, bint numericAnnotations, str filter,
+                  list extraTags, bint dedup, str dedupPath,
+                  size_t gamesQueueSize, size_t batchQueueSize,
+                  size_t maxMemory, size_t nWriters, bint stream,
+                  list partitionBy, int64_t maxFileRows, int64_t maxFileBytes,
+                  size_t maxOpenFiles):
+        self._pool = new ParserPool(nReaders, nWorkers, minSec, maxSec, maxInc,
                                   outdir.encode('utf-8'), elo_edges,
-                                  chunkSize, printFreq, numThreads)
+                                  chunkSize, printFreq, numThreads,
+                                  blockSize, queueDepth, moveOutput,
+                                  hashPlies, numericAnnotations, filter.encode('utf-8'),
+                                  [tag.encode('utf-8') for tag in extraTags],
+                                  dedup, dedupPath.encode('utf-8'),
+                                  gamesQueueSize, batchQueueSize,
+                                  maxMemory, nWriters, stream,
+                                  [key.encode('utf-8') for key in partitionBy],
+                                  maxFileRows, maxFileBytes, maxOpenFiles)
 
     def __dealloc__(self):
         if self._pool != NULL:
@@ -33,7 +63,8 @@ cdef class PyParserPool:
     def join(self):
         """Join all parser threads and close the writer."""
         if self._pool != NULL:
-            self._pool.join()
+            with nogil:
+                self._pool.join()
 
     def enqueue(self, str zst, str name):
         """Enqueue a new file for parsing.
@@ -45,6 +76,14 @@ cdef class PyParserPool:
         if self._pool != NULL:
             self._pool.enqueue(zst.encode('utf-8'), name.encode('utf-8'))
     
+    def stream(self):
+        """Stop accepting files and return the games as a pyarrow.RecordBatchReader."""
+        import pyarrow
+        cdef ArrowArrayStream c_stream
+        if self._pool != NULL:
+            self._pool.exportStream(&c_stream)
+            return pyarrow.RecordBatchReader._import_from_c(<uintptr_t>&c_stream)
+
     def get_completed(self):
         if self._pool != NULL:
             return self._pool.getCompleted()
@@ -53,6 +92,26 @@ cdef class PyParserPool:
         if self._pool != NULL:
             return self._pool.getNGames()
 
+    def get_nduplicates(self):
+        if self._pool != NULL:
+            return self._pool.getNDuplicates()
+
     def get_info(self):
         if self._pool != NULL:
-            return self._pool.getInfo()
\ No newline at end of file
+            return self._pool.getInfo()
+
+def reframe(str src, str dst, size_t frameSize, int level):
+    """Re-compress src into game-aligned, independently decodable frames with a seek table.
+
+    Args:
+        src: Path to the input zst compressed file
+        dst: Path to write the re-framed archive to
+        frameSize: Approximate number of decompressed bytes per frame
+        level: zstd compression level
+    """
+    cdef string csrc = src.encode('utf-8')
+    cdef string cdst = dst.encode('utf-8')
+    cdef int64_t nFrames
+    with nogil:
+        nFrames = reframeZst(csrc, cdst, frameSize, level)
+    return nFrames
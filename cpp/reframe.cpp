@@ -0,0 +1,89 @@
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "zstd.h"
+#include "decompress.h"
+#include "frameIndex.h"
+#include "reframe.h"
+
+static void writeLE(std::ofstream& outfile, uint32_t val) {
+	unsigned char buf[4] = {
+		(unsigned char)(val & 0xFF),
+		(unsigned char)((val >> 8) & 0xFF),
+		(unsigned char)((val >> 16) & 0xFF),
+		(unsigned char)((val >> 24) & 0xFF)
+	};
+	outfile.write(reinterpret_cast<char*>(buf), 4);
+}
+
+struct FrameWriter {
+	ZSTD_CCtx* cctx;
+	std::ofstream outfile;
+	std::vector<char> compressed;
+	std::vector<std::pair<uint32_t, uint32_t> > seekTable;
+
+	FrameWriter(std::string dst, int level) : outfile(dst, std::ios::binary | std::ios::trunc) {
+		if (!outfile) throw std::runtime_error("could not open " + dst);
+		cctx = ZSTD_createCCtx();
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 1);
+	}
+	~FrameWriter() {
+		ZSTD_freeCCtx(cctx);
+	}
+	void writeFrame(std::string& frame) {
+		compressed.resize(ZSTD_compressBound(frame.size()));
+		size_t ret = ZSTD_compress2(cctx, compressed.data(), compressed.size(), frame.data(), frame.size());
+		if (ZSTD_isError(ret)) {
+			throw std::runtime_error("zstd returned " + std::string(ZSTD_getErrorName(ret)));
+		}
+		outfile.write(compressed.data(), ret);
+		seekTable.emplace_back(ret, frame.size());
+		frame.clear();
+	}
+	void writeSeekTable() {
+		writeLE(outfile, SEEK_TABLE_SKIPPABLE_MAGIC);
+		writeLE(outfile, seekTable.size()*8 + 9);
+		for (auto [cSize, dSize]: seekTable) {
+			writeLE(outfile, cSize);
+			writeLE(outfile, dSize);
+		}
+		writeLE(outfile, seekTable.size());
+		outfile.put(0); // no per-frame checksums
+		writeLE(outfile, SEEKABLE_MAGIC);
+		outfile.close();
+		if (!outfile) throw std::runtime_error("error writing seek table");
+	}
+};
+
+int64_t reframeZst(std::string src, std::string dst, size_t frameSize, int level) {
+	// a single frame must fit in the 32-bit sizes of the seek table
+	if (frameSize == 0 || frameSize > 0x7FFFFFFF) {
+		throw std::runtime_error("frameSize must be between 1 and 2^31-1");
+	}
+	DecompressStream decompressor(src, 0, std::filesystem::file_size(src));
+	FrameWriter writer(dst, level);
+	std::string frame;
+	frame.reserve(frameSize + frameSize/8);
+	std::vector<std::string_view> lines;
+
+	while (decompressor.decompressFrame() != 0) {
+		lines.clear();
+		decompressor.getLines(lines);
+		for (auto line: lines) {
+			if (frame.size() >= frameSize && line.substr(0, 7) == "[Event ") {
+				writer.writeFrame(frame);
+			} else if (frame.size() + line.size() >= 0x7FFFFFFF) {
+				throw std::runtime_error("game too large for a single seekable frame");
+			}
+			frame.append(line);
+			frame.push_back('\n');
+		}
+	}
+	frame.append(decompressor.getRemainder());
+	if (frame.size() > 0) {
+		writer.writeFrame(frame);
+	}
+	writer.writeSeekTable();
+	return writer.seekTable.size();
+}
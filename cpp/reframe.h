@@ -0,0 +1,11 @@
+#ifndef REFRAME_H
+#define REFRAME_H
+#include <cstdint>
+#include <string>
+
+// Re-compresses a .pgn.zst archive into independent frames of roughly frameSize
+// decompressed bytes, each ending on a game boundary, followed by a seek table in
+// the zstd seekable format. Returns the number of frames written.
+int64_t reframeZst(std::string src, std::string dst, size_t frameSize, int level);
+
+#endif
@@ -0,0 +1,20 @@
+#include <iostream>
+#include <string>
+#include "reframe.h"
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0] << " <input.pgn.zst> <output.pgn.zst> [frameSizeMiB=8] [level=3]" << std::endl;
+		return 1;
+	}
+	size_t frameSize = (argc > 3 ? std::stoul(argv[3]) : 8) * 1024 * 1024;
+	int level = argc > 4 ? std::stoi(argv[4]) : 3;
+	try {
+		int64_t nFrames = reframeZst(argv[1], argv[2], frameSize, level);
+		std::cout << "wrote " << nFrames << " frames to " << argv[2] << std::endl;
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,149 @@
+#include <cstring>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+static const char EVENT_TAG[] = "[Event ";
+static const size_t EVENT_TAG_LEN = 7;
+
+static inline bool isGameStart(const char* buf, size_t p) {
+	return memcmp(buf + p, EVENT_TAG, EVENT_TAG_LEN) == 0;
+}
+
+static void findNewlinesScalar(const char* buf, size_t begin, size_t end, std::vector<uint32_t>& out) {
+	const char* p = buf + begin;
+	const char* stop = buf + end;
+	while (p < stop) {
+		const char* next = (const char*)memchr(p, '\n', stop - p);
+		if (next == NULL) break;
+		out.push_back(next - buf);
+		p = next + 1;
+	}
+}
+
+// positions after begin are only checked once the preceding byte is known to be '\n'
+static void findGameStartsScalar(const char* buf, size_t begin, size_t end, std::vector<size_t>& out) {
+	if (begin >= end) return;
+	if (begin == 0) {
+		if (isGameStart(buf, 0)) out.push_back(0);
+		begin = 1;
+	}
+	const char* p = buf + begin - 1;
+	const char* stop = buf + end - 1;
+	while (p < stop) {
+		const char* next = (const char*)memchr(p, '\n', stop - p);
+		if (next == NULL) break;
+		size_t pos = next - buf + 1;
+		if (isGameStart(buf, pos)) out.push_back(pos);
+		p = next + 1;
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+static void findNewlinesAvx2(const char* buf, size_t begin, size_t end, std::vector<uint32_t>& out) {
+	const __m256i nl = _mm256_set1_epi8('\n');
+	size_t i = begin;
+	for (; i + 32 <= end; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(buf + i));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, nl));
+		while (mask) {
+			out.push_back(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	findNewlinesScalar(buf, i, end, out);
+}
+
+__attribute__((target("avx2")))
+static void findGameStartsAvx2(const char* buf, size_t begin, size_t end, std::vector<size_t>& out) {
+	if (begin >= end) return;
+	if (begin == 0) {
+		if (isGameStart(buf, 0)) out.push_back(0);
+		begin = 1;
+	}
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i lb = _mm256_set1_epi8('[');
+	size_t i = begin;
+	for (; i + 32 <= end; i += 32) {
+		__m256i prev = _mm256_loadu_si256((const __m256i*)(buf + i - 1));
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(buf + i));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(prev, nl), _mm256_cmpeq_epi8(chunk, lb)));
+		while (mask) {
+			size_t pos = i + __builtin_ctz(mask);
+			if (isGameStart(buf, pos)) out.push_back(pos);
+			mask &= mask - 1;
+		}
+	}
+	findGameStartsScalar(buf, i, end, out);
+}
+
+static void findNewlinesSse2(const char* buf, size_t begin, size_t end, std::vector<uint32_t>& out) {
+	const __m128i nl = _mm_set1_epi8('\n');
+	size_t i = begin;
+	for (; i + 16 <= end; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(buf + i));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+		while (mask) {
+			out.push_back(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	findNewlinesScalar(buf, i, end, out);
+}
+
+static void findGameStartsSse2(const char* buf, size_t begin, size_t end, std::vector<size_t>& out) {
+	if (begin >= end) return;
+	if (begin == 0) {
+		if (isGameStart(buf, 0)) out.push_back(0);
+		begin = 1;
+	}
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i lb = _mm_set1_epi8('[');
+	size_t i = begin;
+	for (; i + 16 <= end; i += 16) {
+		__m128i prev = _mm_loadu_si128((const __m128i*)(buf + i - 1));
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(buf + i));
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(prev, nl), _mm_cmpeq_epi8(chunk, lb)));
+		while (mask) {
+			size_t pos = i + __builtin_ctz(mask);
+			if (isGameStart(buf, pos)) out.push_back(pos);
+			mask &= mask - 1;
+		}
+	}
+	findGameStartsScalar(buf, i, end, out);
+}
+
+static const bool HAVE_AVX2 = __builtin_cpu_supports("avx2");
+
+void findNewlines(const char* buf, size_t begin, size_t end, std::vector<uint32_t>& out) {
+	if (HAVE_AVX2) {
+		findNewlinesAvx2(buf, begin, end, out);
+	} else {
+		findNewlinesSse2(buf, begin, end, out);
+	}
+}
+
+void findGameStarts(const char* buf, size_t begin, size_t end, std::vector<size_t>& out) {
+	if (HAVE_AVX2) {
+		findGameStartsAvx2(buf, begin, end, out);
+	} else {
+		findGameStartsSse2(buf, begin, end, out);
+	}
+}
+
+#else
+
+void findNewlines(const char* buf, size_t begin, size_t end, std::vector<uint32_t>& out) {
+	findNewlinesScalar(buf, begin, end, out);
+}
+
+void findGameStarts(const char* buf, size_t begin, size_t end, std::vector<size_t>& out) {
+	findGameStartsScalar(buf, begin, end, out);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Structural scanners over decompressed PGN. Both use AVX2 or SSE2 when the CPU
+// supports it and fall back to memchr otherwise.
+
+// appends the offsets of all '\n' in buf[begin, end)
+void findNewlines(const char* buf, size_t begin, size_t end, std::vector<uint32_t>& out);
+
+// appends the offsets p in [begin, end) where an "[Event " tag starts a line, i.e.
+// p == 0 or buf[p-1] == '\n'. buf must be readable up to end+6.
+void findGameStarts(const char* buf, size_t begin, size_t end, std::vector<size_t>& out);
+
+#endif
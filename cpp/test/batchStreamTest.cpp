@@ -0,0 +1,141 @@
+// Checks that BatchStream parks producers while queue_size batches wait and resumes
+// them as the reader takes batches, that abandoning the stream resumes parked
+// producers and drops what they queue, and how the stream ends.
+#include <arrow/api.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "batchStream.h"
+#include "executor.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static shared_ptr<arrow::Schema> schema = arrow::schema({arrow::field("value", arrow::int64())});
+
+static vector<PartitionRows> makeRows(int64_t value) {
+	arrow::Int64Builder builder;
+	if (!builder.Append(value).ok()) throw runtime_error("Error building rows");
+	return {{0, arrow::RecordBatch::Make(schema, 1, {*builder.Finish()})}};
+}
+
+// Queues nBatches batches from executor tasks the way block tasks do: a task that is
+// parked returns, and its resume submits a task that carries on.
+struct Producers {
+	shared_ptr<BatchStream> stream;
+	Executor executor;
+	int nBatches;
+	atomic<int> nLeft;
+	atomic<int> nParked;
+
+	Producers(shared_ptr<BatchStream> stream, int nProducers, int nBatches)
+		: stream(stream), executor(4), nBatches(nBatches), nLeft(nProducers), nParked(0) {
+		for (int p = 0; p < nProducers; p++) {
+			executor.submit([this, p] { produce(p, 0); });
+		}
+	}
+
+	void produce(int p, int next) {
+		for (int i = next; i < nBatches; i++) {
+			auto resume = [this, p, i] {
+				executor.submit([this, p, i] { produce(p, i + 1); });
+			};
+			if (!stream->queueBatch(makeRows(p * nBatches + i), resume)) {
+				nParked++;
+				return;
+			}
+		}
+		if (--nLeft == 0) {
+			stream->close();
+			executor.notify();
+		}
+	}
+};
+
+int main() {
+	// every batch arrives once, while producers park and resume on a short queue
+	for (size_t queueSize: {1, 4, 64}) {
+		string what = "queue of " + to_string(queueSize);
+		auto stream = make_shared<BatchStream>(schema, queueSize);
+		auto reader = stream->reader();
+		Producers producers(stream, 8, 200);
+		vector<int> seen(8 * 200, 0);
+		int nRead = 0;
+		while (true) {
+			shared_ptr<arrow::RecordBatch> batch;
+			check(reader->ReadNext(&batch).ok(), what + ": read failed");
+			if (!batch) break;
+			seen[static_pointer_cast<arrow::Int64Array>(batch->column(0))->Value(0)]++;
+			nRead++;
+		}
+		check(nRead == 8 * 200, what + ": " + to_string(nRead) + " batches read");
+		check(count(seen.begin(), seen.end(), 1) == 8 * 200, what + ": batches lost or repeated");
+		check(queueSize == 64 || producers.nParked > 0, what + ": no producer parked");
+	}
+
+	// a producer is parked once queue_size batches wait, and resumed by a read
+	{
+		auto stream = make_shared<BatchStream>(schema, 2);
+		auto reader = stream->reader();
+		int nResumed = 0;
+		auto resume = [&nResumed] { nResumed++; };
+		check(stream->queueBatch(makeRows(0), resume), "first of two batches parked");
+		check(!stream->queueBatch(makeRows(1), resume), "second of two batches not parked");
+		check(stream->queueBatch(makeRows(2), nullptr), "parked without a resume");
+		check(nResumed == 0, "resumed before a read");
+		shared_ptr<arrow::RecordBatch> batch;
+		check(reader->ReadNext(&batch).ok() && batch, "read failed");
+		check(nResumed == 0, "resumed with queue_size batches still waiting");
+		check(reader->ReadNext(&batch).ok() && batch, "read failed");
+		check(nResumed == 1, to_string(nResumed) + " resumes after the queue went down");
+
+		// a stream that fails ends with its error after the batches queued before
+		stream->fail("zstd returned Data corruption detected");
+		check(reader->ReadNext(&batch).ok() && batch, "batch queued before the failure lost");
+		auto status = reader->ReadNext(&batch);
+		check(!status.ok() && !batch && status.message() == "zstd returned Data corruption detected", "failure not reported: " + status.ToString());
+
+		bool threw = false;
+		try {
+			stream->reader();
+		} catch (runtime_error&) {
+			threw = true;
+		}
+		check(threw, "reader taken twice");
+	}
+
+	// releasing the reader while producers are parked resumes them, and they finish
+	// without a reader
+	{
+		auto stream = make_shared<BatchStream>(schema, 2);
+		auto reader = stream->reader();
+		Producers producers(stream, 8, 1000);
+		shared_ptr<arrow::RecordBatch> batch;
+		for (int i = 0; i < 10; i++) {
+			check(reader->ReadNext(&batch).ok() && batch, "read before abandoning failed");
+		}
+		reader.reset();
+		producers.executor.wait([&producers] { return producers.nLeft == 0; });
+		check(producers.nParked > 0, "no producer parked before abandoning");
+		check(producers.nLeft == 0, to_string(producers.nLeft) + " producers never finished");
+	}
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("batch stream checks passed\n");
+	return 0;
+}
@@ -0,0 +1,161 @@
+// SAN replay checks for Board, plus perft counts. Board has no move generator, so
+// perft tries every from-to pair in fully disambiguated SAN and counts what plays.
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "board.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static int square(const char* name) {
+	return (name[1] - '1')*8 + (name[0] - 'a');
+}
+
+// number of moves of mvs that replay, -1 if all of them do
+static int replayed(const char* mvs, Board& board) {
+	vector<uint16_t> codes;
+	return replaySan(mvs, board, codes) ? -1 : (int)codes.size();
+}
+
+static void checkPlays(const char* mvs, Board& board) {
+	int n = replayed(mvs, board);
+	check(n < 0, string(mvs) + ": stopped after " + to_string(n) + " moves");
+}
+
+static void checkStops(const char* mvs, int at, Board& board) {
+	int n = replayed(mvs, board);
+	check(n == at, string(mvs) + ": expected to stop after " + to_string(at) + " moves, got " + to_string(n));
+}
+
+static void checkPiece(Board& board, const char* sq, Color color, PieceType type, const char* mvs) {
+	int s = square(sq);
+	check(board.pieceAt(s) == type && (type == NO_PIECE || board.colorAt(s) == color),
+		string(mvs) + ": unexpected piece on " + sq);
+}
+
+static size_t perft(const Board& board, int depth) {
+	static const char PIECE_CHARS[] = " NBRQK";
+	static const char* const PROMOS[] = {"=N", "=B", "=R", "=Q"};
+	if (depth == 0) return 1;
+	Color us = board.getSideToMove();
+	size_t n = 0;
+	uint16_t move;
+	for (const char* castle: {"O-O", "O-O-O"}) {
+		Board next = board;
+		if (next.playSan(castle, move)) n += perft(next, depth - 1);
+	}
+	for (int from = 0; from < 64; from++) {
+		PieceType type = board.pieceAt(from);
+		if (type == NO_PIECE || board.colorAt(from) != us) continue;
+		for (int to = 0; to < 64; to++) {
+			if (board.pieceAt(to) != NO_PIECE && board.colorAt(to) == us) continue;
+			bool takes = board.pieceAt(to) != NO_PIECE || (type == PAWN && to == board.getEpSquare());
+			string san;
+			if (type != PAWN) san += PIECE_CHARS[type];
+			san += 'a' + from % 8;
+			san += '1' + from / 8;
+			if (takes) san += 'x';
+			san += 'a' + to % 8;
+			san += '1' + to / 8;
+			bool promotes = type == PAWN && (to / 8 == 0 || to / 8 == 7);
+			for (int i = 0; i < (promotes ? 4 : 1); i++) {
+				Board next = board;
+				if (next.playSan(promotes ? san + PROMOS[i] : san, move)) n += perft(next, depth - 1);
+			}
+		}
+	}
+	return n;
+}
+
+int main() {
+	Board board;
+
+	// castling on both sides
+	const char* kingside = "e4 e5 Nf3 Nc6 Bc4 Bc5 O-O Nf6 d3 O-O";
+	checkPlays(kingside, board);
+	checkPiece(board, "g1", WHITE, KING, kingside);
+	checkPiece(board, "f1", WHITE, ROOK, kingside);
+	checkPiece(board, "g8", BLACK, KING, kingside);
+	checkPiece(board, "f8", BLACK, ROOK, kingside);
+	const char* queenside = "d4 d5 Nc3 Nc6 Bf4 Bf5 Qd2 Qd7 O-O-O O-O-O";
+	checkPlays(queenside, board);
+	checkPiece(board, "c1", WHITE, KING, queenside);
+	checkPiece(board, "d1", WHITE, ROOK, queenside);
+	checkPiece(board, "c8", BLACK, KING, queenside);
+	checkPiece(board, "d8", BLACK, ROOK, queenside);
+	// not out of check, through an attacked square or after the king has moved
+	checkStops("e4 e5 Nf3 Nf6 Bc4 Be7 Bxf7+ O-O", 7, board);
+	checkStops("e4 b6 Nh3 Ba6 g3 Nc6 Bg2 Nf6 O-O", 8, board);
+	checkStops("e4 e5 Nf3 Nf6 Bc4 Bc5 Ke2 Ke7 Ke1 Ke8 O-O", 10, board);
+
+	// en passant, only right after the double push
+	const char* ep = "e4 Nf6 e5 d5 exd6";
+	checkPlays(ep, board);
+	checkPiece(board, "d6", WHITE, PAWN, ep);
+	checkPiece(board, "d5", WHITE, NO_PIECE, ep);
+	checkStops("e4 Nf6 e5 d5 h3 h6 exd6", 6, board);
+
+	// promotion, which must be spelled out
+	const char* promo = "h4 g5 hxg5 h6 gxh6 Bg7 hxg7 Nf6 gxh8=Q";
+	checkPlays(promo, board);
+	checkPiece(board, "h8", WHITE, QUEEN, promo);
+	const char* under = "h4 g5 hxg5 h6 gxh6 Bg7 hxg7 Nf6 gxh8=N";
+	checkPlays(under, board);
+	checkPiece(board, "h8", WHITE, KNIGHT, under);
+	checkStops("h4 g5 hxg5 h6 gxh6 Bg7 hxg7 Nf6 gxh8", 8, board);
+	checkStops("e4 e5 Nf3=Q", 2, board);
+
+	// disambiguation, which a pin can make unnecessary
+	checkStops("Nf3 d5 Nc3 e5 Nb5 Nf6 Nd4", 6, board);
+	checkPlays("Nf3 d5 Nc3 e5 Nb5 Nf6 Nfd4", board);
+	checkPlays("Nf3 d5 Nc3 e5 Nb5 Nf6 Nf3d4", board);
+	const char* pinned = "d4 e6 Nd2 Bb4 Nf3";
+	checkPlays(pinned, board);
+	checkPiece(board, "d2", WHITE, KNIGHT, pinned);
+	checkPiece(board, "f3", WHITE, KNIGHT, pinned);
+	checkStops("d4 e6 Nd2 Bb4 Ndf3", 4, board);
+
+	// illegal and malformed moves
+	checkStops("e5", 0, board);
+	checkStops("Ke2", 0, board);
+	checkStops("Nf4", 0, board);
+	checkStops("exd3", 0, board);
+	checkStops("e4 e5 Qh5 Nc6 Bc4 Nf6 Qxf7# Ke7", 7, board);
+	checkStops("e9", 0, board);
+	checkStops("Zf3", 0, board);
+	// pushes onto the mover's own back rank
+	checkStops("e4 e5 Ke2 Ke7 e1", 4, board);
+	checkStops("d4 e5 Nf3 e8", 3, board);
+
+	// perft from the start and from "Kiwipete", reached here by SAN
+	board.reset();
+	const size_t START[] = {20, 400, 8902};
+	for (int depth = 1; depth <= 3; depth++) {
+		size_t n = perft(board, depth);
+		check(n == START[depth-1], "start perft " + to_string(depth) + " = " + to_string(n));
+	}
+	const char* kiwipete = "d4 b5 d5 b4 e4 h5 Nc3 h4 Nf3 h3 Ne5 e6 Bd2 g6 Qf3 Nf6 Be2 Bg7 Qg3 Qe7 "
+		"Qf3 Ba6 Qg3 Nc6 Qf3 Na5 Qg3 Nc4 Qf3 Nb6";
+	checkPlays(kiwipete, board);
+	const size_t KIWIPETE[] = {48, 2039, 97862};
+	for (int depth = 1; depth <= 3; depth++) {
+		size_t n = perft(board, depth);
+		check(n == KIWIPETE[depth-1], "kiwipete perft " + to_string(depth) + " = " + to_string(n));
+	}
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("board checks passed\n");
+	return 0;
+}
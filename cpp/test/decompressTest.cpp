@@ -0,0 +1,204 @@
+// Reads small archives through DecompressStream the way ParallelParser's readers do,
+// with and without the IoPool, and checks that every game comes out exactly once,
+// also from archives reframed at game boundaries.
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "decompress.h"
+#include "frameIndex.h"
+#include "ioPool.h"
+#include "reframe.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static string makeGames(int n) {
+	string pgn;
+	for (int i = 0; i < n; i++) {
+		pgn += "[Event \"Rated Blitz game\"]\n[Site \"https://lichess.org/g" + to_string(i) + "\"]\n\n";
+		pgn += "1. e4 { [%clk 0:03:00] } 1... e5 { [%clk 0:03:00] } " + string(i % 5, ' ') + "1-0\n\n";
+	}
+	return pgn;
+}
+
+// one zstd frame per part
+static void writeArchive(const string& path, const vector<string>& parts) {
+	ofstream out(path, ios::binary);
+	for (auto& part: parts) {
+		string frame(ZSTD_compressBound(part.size()), '\0');
+		size_t n = ZSTD_compress(frame.data(), frame.size(), part.data(), part.size(), 3);
+		out.write(frame.data(), n);
+	}
+}
+
+// the games of [frameStart, frameEnd), as a reader of a file of fileEnd bytes gets them
+static vector<string> readRange(const string& path, size_t frameStart, size_t frameEnd, size_t fileEnd, size_t blockSize, shared_ptr<IoPool> ioPool, int queueDepth) {
+	DecompressStream stream(path, frameStart, frameEnd, blockSize, ioPool, queueDepth);
+	vector<string> games;
+	vector<string_view> spans;
+	bool extended = false;
+	while (true) {
+		if (stream.decompressFrame() != 0) {
+			spans.clear();
+			stream.getGames(spans);
+			games.insert(games.end(), spans.begin(), spans.end());
+		} else if (stream.pendingGame() && !extended && frameEnd < fileEnd) {
+			stream.extend(fileEnd);
+			extended = true;
+		} else {
+			if (stream.pendingGame() && !stream.getRemainder().empty()) {
+				games.emplace_back(stream.getRemainder());
+			}
+			break;
+		}
+	}
+	// reading on after the end must keep returning nothing
+	check(stream.decompressFrame() == 0 && stream.decompressFrame() == 0, "read past the end of " + path);
+	return games;
+}
+
+static string joined(const vector<string>& games) {
+	string all;
+	for (auto& game: games) all += game;
+	return all;
+}
+
+int main() {
+	string dir = filesystem::temp_directory_path() / ("decompressTest." + to_string(getpid()));
+	filesystem::create_directories(dir);
+	auto ioPool = make_shared<IoPool>(2);
+
+	string pgn = makeGames(200);
+	string single = dir + "/single.pgn.zst";
+	writeArchive(single, {pgn});
+	size_t singleSize = filesystem::file_size(single);
+
+	// ranges that end mid-block and past the end of the file, so the last reads are short
+	for (int queueDepth: {0, 1, 3}) {
+		for (size_t blockSize: {7, 64, 1000, 1 << 20}) {
+			for (size_t end: {singleSize, singleSize + 1, singleSize + blockSize/2 + 1, singleSize + 3*blockSize}) {
+				auto games = readRange(single, 0, end, end, blockSize, queueDepth ? ioPool : nullptr, queueDepth);
+				string what = "single frame, depth " + to_string(queueDepth) + ", blocks of " + to_string(blockSize) + ", end " + to_string(end);
+				check(games.size() == 200, what + ": " + to_string(games.size()) + " games");
+				check(joined(games) == pgn, what + ": text differs");
+			}
+		}
+	}
+
+	// two frames split in the middle of a game: the first reader finishes it past its
+	// range, and the second one skips it
+	size_t cut = pgn.find("[Event", pgn.size() / 2) + 20;
+	string split = dir + "/split.pgn.zst";
+	writeArchive(split, {pgn.substr(0, cut), pgn.substr(cut)});
+	size_t splitSize = filesystem::file_size(split);
+	writeArchive(dir + "/first.zst", {pgn.substr(0, cut)});
+	size_t boundary = filesystem::file_size(dir + "/first.zst");
+	for (int queueDepth: {0, 2}) {
+		for (size_t blockSize: {7, 64, 1000}) {
+			auto shared = queueDepth ? ioPool : nullptr;
+			auto games = readRange(split, 0, boundary, splitSize, blockSize, shared, queueDepth);
+			auto rest = readRange(split, boundary, splitSize, splitSize, blockSize, shared, queueDepth);
+			string what = "split frames, depth " + to_string(queueDepth) + ", blocks of " + to_string(blockSize);
+			check(games.size() + rest.size() == 200, what + ": " + to_string(games.size()) + " + " + to_string(rest.size()) + " games");
+			games.insert(games.end(), rest.begin(), rest.end());
+			check(joined(games) == pgn, what + ": text differs");
+		}
+	}
+
+	// a range whose reader never sees a game start, ending with the first bytes of the
+	// next game's [Event line, so the scan's lookahead runs past the end of the range
+	string three = makeGames(3);
+	size_t second = three.find("[Event", 1);
+	size_t third = three.find("[Event", second + 1);
+	for (size_t cut = 1; cut <= 7; cut++) {
+		vector<string> parts = {three.substr(0, second + 10), three.substr(second + 10, third + cut - second - 10), three.substr(third + cut)};
+		string path = dir + "/cut" + to_string(cut) + ".pgn.zst";
+		writeArchive(path, parts);
+		vector<size_t> ends;
+		size_t offset = 0;
+		for (auto& part: parts) {
+			writeArchive(dir + "/part.zst", {part});
+			offset += filesystem::file_size(dir + "/part.zst");
+			ends.push_back(offset);
+		}
+		for (int queueDepth: {0, 2}) {
+			for (size_t blockSize: {5, 64, 1000}) {
+				vector<string> games;
+				size_t start = 0;
+				for (auto end: ends) {
+					auto range = readRange(path, start, end, offset, blockSize, queueDepth ? ioPool : nullptr, queueDepth);
+					games.insert(games.end(), range.begin(), range.end());
+					start = end;
+				}
+				string what = "tag cut after " + to_string(cut) + " bytes, depth " + to_string(queueDepth) + ", blocks of " + to_string(blockSize);
+				check(games.size() == 3, what + ": " + to_string(games.size()) + " games");
+				check(joined(games) == three, what + ": text differs");
+			}
+		}
+
+		// the same cut at the end of the file loses no bytes
+		string truncated = three.substr(0, third + cut);
+		writeArchive(path, {truncated});
+		size_t size = filesystem::file_size(path);
+		auto games = readRange(path, 0, size, size, 64, nullptr, 0);
+		check(games.size() >= 2 && joined(games) == truncated, "tag cut after " + to_string(cut) + " bytes at the end of the file");
+	}
+
+	// reframing an archive whose frames cut games anywhere gives frames that start with
+	// a game, recorded in the seek table, and readers split at them get every game once
+	vector<string> unaligned;
+	for (size_t offset = 0; offset < pgn.size(); offset += 333) {
+		unaligned.push_back(pgn.substr(offset, 333));
+	}
+	string src = dir + "/unaligned.pgn.zst";
+	writeArchive(src, unaligned);
+	for (size_t frameSize: {1, 1000, 5000, 1 << 20}) {
+		string dst = dir + "/reframed" + to_string(frameSize) + ".pgn.zst";
+		int64_t nFrames = reframeZst(src, dst, frameSize, 3);
+		string what = "reframed into frames of " + to_string(frameSize);
+		vector<FrameInfo> frames;
+		check(readSeekTable(dst, frames), what + ": no seek table");
+		check(static_cast<int64_t>(frames.size()) == nFrames, what + ": " + to_string(frames.size()) + " of " + to_string(nFrames) + " frames in the seek table");
+		uint64_t offset = 0, decompressed = 0;
+		for (auto& frame: frames) {
+			check(frame.offset == offset, what + ": frame at " + to_string(frame.offset) + " instead of " + to_string(offset));
+			check(pgn.compare(decompressed, 7, "[Event ") == 0, what + ": frame does not start with a game");
+			offset += frame.compressedSize;
+			decompressed += frame.decompressedSize;
+		}
+		check(decompressed == pgn.size(), what + ": " + to_string(decompressed) + " bytes decompressed");
+		size_t size = filesystem::file_size(dst);
+		for (int nReaders: {1, 3, 7}) {
+			vector<size_t> boundaries = getFrameBoundaries(dst, nReaders);
+			check(boundaries.front() == 0 && boundaries.back() == size, what + ": boundaries do not cover the file");
+			vector<string> games;
+			for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+				auto range = readRange(dst, boundaries[i], boundaries[i+1], size, 64, nullptr, 0);
+				games.insert(games.end(), range.begin(), range.end());
+			}
+			string readers = what + ", " + to_string(nReaders) + " readers";
+			check(games.size() == 200, readers + ": " + to_string(games.size()) + " games");
+			check(joined(games) == pgn, readers + ": text differs");
+		}
+	}
+
+	filesystem::remove_all(dir);
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("decompress checks passed\n");
+	return 0;
+}
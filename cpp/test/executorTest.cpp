@@ -0,0 +1,97 @@
+// Checks that the executor runs every task, including ones submitted by tasks and
+// ones still queued when it is destroyed, and that a task that throws reaches wait.
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "executor.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+// a task that splits itself until depth runs out, as block tasks resubmit themselves
+static void spread(Executor& executor, atomic<int>& nRun, int depth) {
+	nRun++;
+	if (depth > 0) {
+		executor.submit([&executor, &nRun, depth] { spread(executor, nRun, depth - 1); });
+		executor.submit([&executor, &nRun, depth] { spread(executor, nRun, depth - 1); });
+	}
+}
+
+int main() {
+	for (size_t nThreads: {1, 2, 8}) {
+		string what = to_string(nThreads) + " workers";
+
+		// tasks submitted from outside and from tasks all run before the destructor returns
+		atomic<int> nRun(0);
+		{
+			Executor executor(nThreads);
+			check(executor.size() == nThreads, what + ": size");
+			for (int i = 0; i < 100; i++) {
+				executor.submit([&executor, &nRun] { spread(executor, nRun, 6); });
+			}
+		}
+		check(nRun == 100 * 127, what + ": " + to_string(nRun) + " tasks run when destroyed");
+
+		// wait returns once the tasks say they are done
+		atomic<int> nLeft(1000);
+		{
+			Executor executor(nThreads);
+			for (int i = 0; i < 1000; i++) {
+				executor.submit([&executor, &nLeft] {
+					if (--nLeft == 0) {
+						executor.notify();
+					}
+				});
+			}
+			executor.wait([&nLeft] { return nLeft == 0; });
+			check(nLeft == 0 && !executor.failure(), what + ": wait");
+		}
+
+		// a task that throws doesn't take the worker down; wait gives up on the tasks
+		// that will never finish, and the first exception is kept
+		{
+			Executor executor(nThreads);
+			atomic<int> nDone(0);
+			for (int i = 0; i < 50; i++) {
+				executor.submit([&nDone, i] {
+					if (i % 10 == 3) {
+						throw runtime_error("task " + to_string(i));
+					}
+					nDone++;
+				});
+			}
+			executor.wait([&nDone] { return nDone == 50; });
+			auto error = executor.failure();
+			check(error != nullptr, what + ": failure recorded");
+			string message;
+			try {
+				rethrow_exception(error);
+			} catch (runtime_error& e) {
+				message = e.what();
+			}
+			check(message.rfind("task ", 0) == 0, what + ": failure is '" + message + "'");
+			check(nDone < 50, what + ": " + to_string(nDone) + " tasks done after a failure");
+			// tasks submitted after the failure are dropped
+			bool ran = false;
+			executor.submit([&ran] { ran = true; });
+			executor.wait([] { return false; });
+			check(!ran, what + ": task run after a failure");
+		}
+	}
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("executor checks passed\n");
+	return 0;
+}
@@ -0,0 +1,119 @@
+// Checks that GameSet keeps each fingerprint once whichever shard and slot it lands
+// in, while threads insert the same games concurrently, and across a save and load.
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "gameSet.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static const int N_GAMES = 200000;
+
+static string site(int i) {
+	return "https://lichess.org/" + to_string(i);
+}
+
+int main() {
+	// fingerprints are persisted, so they must not change
+	check(gameFingerprint(site(1)) == 0x255D87EA579A6CF3ULL, "fingerprint changed");
+	check(gameFingerprint(site(1)) != gameFingerprint(site(2)), "fingerprints of different games are equal");
+	check(gameFingerprint("") != 0, "fingerprint 0 marks an empty slot");
+
+	// the games land in every shard, and every shard grows past its first table
+	set<uint64_t> shardsHit;
+	for (int i = 0; i < N_GAMES; i++) {
+		shardsHit.insert(gameFingerprint(site(i)) >> 58);
+	}
+	check(shardsHit.size() == 64, to_string(shardsHit.size()) + " shards hit");
+
+	// threads insert overlapping ranges, so most games are inserted by two threads at
+	// once and only one of them may see it as new
+	for (int nThreads: {1, 4, 8}) {
+		GameSet seen;
+		atomic<int> nNew(0);
+		vector<thread> threads;
+		for (int t = 0; t < nThreads; t++) {
+			threads.emplace_back([&seen, &nNew, t, nThreads] {
+				int begin = t * N_GAMES / nThreads;
+				int end = min(N_GAMES, (t + 2) * N_GAMES / nThreads);
+				for (int i = begin; i < end; i++) {
+					if (seen.insert(gameFingerprint(site(i)))) nNew++;
+				}
+				for (int i = begin; i < end; i++) {
+					if (seen.insert(gameFingerprint(site(i)))) nNew++;
+				}
+			});
+		}
+		for (auto& thread: threads) {
+			thread.join();
+		}
+		string what = to_string(nThreads) + " threads";
+		check(nNew == N_GAMES, what + ": " + to_string(nNew) + " games new");
+		check(seen.size() == static_cast<size_t>(N_GAMES), what + ": size " + to_string(seen.size()));
+	}
+
+	// fingerprints with the same low bits probe past each other in one shard, and
+	// aren't confused with the same low bits in another shard
+	{
+		GameSet seen;
+		bool allNew = true;
+		for (uint64_t shard: {0, 1, 63}) {
+			for (uint64_t k = 0; k < 3000; k++) {
+				allNew &= seen.insert((shard << 58) | (k << 11) | 5);
+			}
+		}
+		check(allNew, "colliding fingerprints taken as duplicates");
+		bool anyNew = false;
+		for (uint64_t shard: {0, 1, 63}) {
+			for (uint64_t k = 0; k < 3000; k++) {
+				anyNew |= seen.insert((shard << 58) | (k << 11) | 5);
+			}
+		}
+		check(!anyNew, "colliding fingerprints inserted twice");
+		check(seen.size() == 9000, "colliding fingerprints: size " + to_string(seen.size()));
+	}
+
+	// a saved set drops the same games after loading it
+	string path = filesystem::temp_directory_path() / ("gameSetTest." + to_string(getpid()));
+	{
+		GameSet seen;
+		seen.load(path);
+		check(seen.size() == 0, "loading a missing file");
+		for (int i = 0; i < 5000; i++) {
+			seen.insert(gameFingerprint(site(i)));
+		}
+		seen.save(path);
+	}
+	{
+		GameSet seen;
+		seen.load(path);
+		check(seen.size() == 5000, "loaded " + to_string(seen.size()) + " games");
+		int nNew = 0;
+		for (int i = 0; i < 6000; i++) {
+			if (seen.insert(gameFingerprint(site(i)))) nNew++;
+		}
+		check(nNew == 1000, "after loading, " + to_string(nNew) + " games new");
+	}
+	filesystem::remove(path);
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("game set checks passed\n");
+	return 0;
+}
@@ -0,0 +1,127 @@
+// Checks MemoryBudget's admission, parking and resuming, and that the pressure handler
+// is called once per episode, also with threads acquiring and releasing at once.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "memoryBudget.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+int main() {
+	// without a limit nothing waits
+	{
+		MemoryBudget budget(0);
+		check(budget.tryAcquire(1 << 30, [] {}) && budget.tryAcquire(1 << 30, [] {}), "unlimited budget refused bytes");
+		check(!budget.overLimit(), "unlimited budget over its limit");
+	}
+
+	{
+		MemoryBudget budget(100);
+		int nPressure = 0;
+		budget.setPressureHandler([&nPressure] { nPressure++; });
+		int nResumed = 0;
+		auto resume = [&nResumed] { nResumed++; };
+
+		check(budget.tryAcquire(60, resume), "60 of 100 bytes refused");
+		check(budget.tryAcquire(40, resume), "the last 40 of 100 bytes refused");
+		check(!budget.tryAcquire(1, resume), "a byte past the limit taken");
+		check(!budget.tryAcquire(30, resume), "30 bytes past the limit taken");
+		check(nPressure == 1 && budget.underPressure(), to_string(nPressure) + " pressure calls for two parked readers");
+		check(nResumed == 0, "resumed before a release");
+
+		// a release resumes every waiter once, and they try again themselves
+		budget.release(40);
+		check(nResumed == 2, to_string(nResumed) + " waiters resumed");
+		budget.release(10);
+		check(nResumed == 2, "waiters resumed twice");
+		check(budget.used() == 50, to_string(budget.used()) + " bytes used");
+
+		// the handler is only asked again once it has answered
+		check(!budget.tryAcquire(51, resume), "51 bytes taken with 50 left");
+		check(nPressure == 1, "pressure handler called again before it answered");
+		budget.pressureRelieved();
+		check(!budget.underPressure(), "under pressure after it was relieved");
+		check(!budget.tryAcquire(51, resume), "51 bytes taken with 50 left");
+		check(nPressure == 2, "pressure handler not called after it answered");
+		budget.release(50);
+		check(budget.used() == 0, to_string(budget.used()) + " bytes used after releasing everything");
+
+		// an empty budget takes a block larger than its limit, or nothing could move
+		check(budget.tryAcquire(500, resume), "oversized block refused by an empty budget");
+		check(budget.overLimit(), "500 bytes not over a limit of 100");
+		budget.release(500);
+
+		// charges never wait but count against the limit
+		budget.charge(80);
+		check(!budget.overLimit(), "80 bytes over a limit of 100");
+		check(!budget.tryAcquire(30, resume), "30 bytes taken on top of 80 charged");
+		budget.charge(30);
+		check(budget.overLimit(), "110 bytes not over a limit of 100");
+		budget.release(110);
+		check(budget.used() == 0, "charges not released");
+	}
+
+	// threads take and give back blocks; a parked thread waits for its resume, so a
+	// lost wakeup hangs it until the timeout
+	for (int nThreads: {2, 8}) {
+		MemoryBudget budget(100);
+		atomic<bool> overdrawn(false);
+		atomic<bool> lost(false);
+		vector<thread> threads;
+		for (int t = 0; t < nThreads; t++) {
+			threads.emplace_back([&budget, &overdrawn, &lost, t] {
+				mutex mtx;
+				condition_variable cv;
+				bool resumed = false;
+				auto resume = [&mtx, &cv, &resumed] {
+					lock_guard<mutex> lock(mtx);
+					resumed = true;
+					cv.notify_one();
+				};
+				size_t bytes = 10 + 7 * t;
+				for (int i = 0; i < 2000; i++) {
+					while (!budget.tryAcquire(bytes, resume)) {
+						unique_lock<mutex> lock(mtx);
+						if (!cv.wait_for(lock, chrono::seconds(10), [&resumed] { return resumed; })) {
+							lost = true;
+							return;
+						}
+						resumed = false;
+					}
+					if (budget.used() > 100) {
+						overdrawn = true;
+					}
+					budget.release(bytes);
+				}
+			});
+		}
+		for (auto& thread: threads) {
+			thread.join();
+		}
+		string what = to_string(nThreads) + " threads";
+		check(!lost, what + ": a parked thread was never resumed");
+		check(!overdrawn, what + ": more than the limit in use");
+		check(budget.used() == 0, what + ": " + to_string(budget.used()) + " bytes left in use");
+	}
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("memory budget checks passed\n");
+	return 0;
+}
@@ -0,0 +1,234 @@
+// Differential test of parseMoves against the RE2 parser it replaced, kept here as
+// the reference. Generated lichess-style movetexts must parse the same with both;
+// the inputs where the old parser was wrong are checked separately, along with what
+// each parser makes of them.
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <re2/re2.h>
+#include <string>
+#include <tuple>
+#include "parseMoves.h"
+
+using namespace std;
+
+namespace reference {
+
+const string MV_PAT = "(O-O-O\\+?#?|O-O\\+?#?|[a-hRNBQK]+[0-9=x]*[a-hRNBQK]*[0-9]*[=RNBQ+#]*)\\??\\??\\!?";
+const string CLK_PAT = "(?:\\{ (?:\\[%eval ([0-9.\\-#]+)\\] )?(?:\\[%clk ([0-9:]+)\\] )?\\})?";
+const string NUM_PAT = "[0-9]+\\.";
+const string NUM_ALT_PAT = "(?:" + NUM_PAT + "\\.\\.)?";
+const string RESULT_PAT = ".*(1/2-1/2|0-1|1-0)";
+
+const re2::RE2 fullMovePat(NUM_PAT + " " + MV_PAT + " " + CLK_PAT + " ?" + NUM_ALT_PAT + " ?" + "(?:" + MV_PAT + ")? ?" + CLK_PAT);
+
+string nextMoveStr(string& moveStr, int& idx, int curmv) {
+	int mvstart = idx;
+	string nextmv = to_string(curmv+1) + ". ";
+
+	bool inParens = false;
+	bool inBracket = false;
+	while(idx < (int)moveStr.size()) {
+		if (inParens) {
+			while (moveStr[idx] != ')') idx++;
+			inParens = false;
+		} else if (inBracket) {
+			while (moveStr[idx] != '}') idx++;
+			inBracket = false;
+		} else if (moveStr[idx] == '(') {
+			inParens = true;
+		} else if (moveStr[idx] == '{') {
+			inBracket = true;
+		} else if (moveStr.substr(idx, nextmv.size()) == nextmv) {
+			break;
+		}
+		idx++;
+	}
+
+	string ss = moveStr.substr(mvstart, idx-mvstart);
+	return ss;
+}
+
+string clkToSec(string timeStr) {
+	int m = stoi(timeStr.substr(2, 2));
+	int s = stoi(timeStr.substr(5, 2));
+	return to_string(m * 60 + s);
+}
+
+tuple<string, string, string, int8_t> parseMoves(string moveStr) {
+	string mvs = "";
+	string clk = "";
+	string eval = "";
+	int8_t result = 0;
+	int curmv = 1;
+	int idx = 0;
+
+	while (idx < (int)moveStr.size()) {
+		string ss = nextMoveStr(moveStr, idx, curmv);
+		string wm="", bm="", weval="", wclk="", beval="", bclk="";
+		re2::RE2::PartialMatch(ss, fullMovePat, &wm, &weval, &wclk, &bm, &beval, &bclk);
+
+		if (idx == (int)moveStr.size()) {
+			string res;
+			re2::RE2::PartialMatch(moveStr.substr(idx-7,7), RESULT_PAT, &res);
+			if (res == "1/2-1/2") {
+				result = 2;
+			} else if (res == "0-1") {
+				result = 1;
+			} else {
+				result = 0;
+			}
+		}
+
+		if (wm == "") {
+			break;
+		}
+		if (weval != "") {
+			eval += weval + " ";
+		}
+		if (wclk != "") {
+			clk += clkToSec(wclk) + " ";
+		}
+		mvs += wm + " ";
+
+		if (bclk != "") {
+			clk += clkToSec(bclk) + " ";
+		}
+		if (bm != "") {
+			mvs += bm + " ";
+		}
+		if (beval != "") {
+			eval += beval + " ";
+		}
+		curmv++;
+	}
+	return make_tuple(mvs.substr(0, mvs.size()-1), clk.substr(0, clk.size()-1), eval.substr(0, eval.size()-1), result);
+}
+
+}
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what, const string& movetext) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n  %s\n", what.c_str(), movetext.c_str());
+	}
+}
+
+// A lichess export: "1. e4 { [%eval 0.17] [%clk 0:03:00] } 1... e5 { ... } 2. ..."
+// with evals on some games only and clocks under an hour, which is the format the
+// old parser was written for.
+static string randomGame(mt19937& rng) {
+	static const char* const sans[] = {
+		"e4", "e5", "Nf3", "Nc6", "Bb5", "a6", "Ba4", "Nf6", "O-O", "Be7", "Re1", "b5",
+		"Bb3", "d6", "c3", "O-O-O", "exd5", "Qxd8+", "Kxd8", "e8=Q+", "gxh1=N", "Rae1",
+		"N1d2", "Qh4#", "Bxf7+", "Nbd7", "R8a7", "cxb8=R", "h3", "Kg1"
+	};
+	static const char* const results[] = {"1-0", "0-1", "1/2-1/2"};
+	uniform_int_distribution<int> san(0, sizeof(sans)/sizeof(sans[0]) - 1);
+	bool evals = rng() % 2;
+	int plies = 1 + rng() % 120;
+	string game;
+	for (int ply = 0; ply < plies; ply++) {
+		int num = ply/2 + 1;
+		game += to_string(num) + (ply % 2 ? "... " : ". ");
+		game += sans[san(rng)];
+		game += " { ";
+		if (evals) {
+			if (rng() % 10 == 0) {
+				game += "[%eval #" + string(rng() % 2 ? "-" : "") + to_string(1 + rng() % 9) + "] ";
+			} else {
+				char buf[32];
+				snprintf(buf, sizeof(buf), "[%%eval %.2f] ", (int(rng() % 2001) - 1000) / 100.0);
+				game += buf;
+			}
+		}
+		char clk[32];
+		snprintf(clk, sizeof(clk), "[%%clk 0:%02d:%02d] } ", int(rng() % 60), int(rng() % 60));
+		game += clk;
+	}
+	return game + results[rng() % 3];
+}
+
+static void checkSame(const string& movetext, ParsedMoves& parsed) {
+	auto [mvs, clk, eval, result] = reference::parseMoves(movetext);
+	parseMoves(movetext, parsed);
+	check(parsed.mvs == mvs, "moves \"" + parsed.mvs + "\" != \"" + mvs + "\"", movetext);
+	check(parsed.clk == clk, "clk \"" + parsed.clk + "\" != \"" + clk + "\"", movetext);
+	check(parsed.eval == eval, "eval \"" + parsed.eval + "\" != \"" + eval + "\"", movetext);
+	check(parsed.result == result, "result " + to_string(parsed.result) + " != " + to_string(result), movetext);
+}
+
+struct Divergence {
+	const char* why;
+	string movetext;
+	// what parseMoves gives
+	string mvs;
+	string clk;
+	string eval;
+	// what the old parser gave instead
+	string oldMvs;
+	string oldClk;
+	string oldEval;
+};
+
+int main() {
+	ParsedMoves parsed;
+	mt19937 rng(12345);
+	for (int g = 0; g < 20000; g++) {
+		checkSame(randomGame(rng), parsed);
+	}
+
+	// intentional differences, where the old parser was wrong
+	const Divergence divergences[] = {
+		{"clocks of an hour or more count the hours",
+			"1. e4 { [%clk 1:02:03] } 1... e5 { [%clk 1:00:00] } 1-0",
+			"e4 e5", "3723 3600", "",
+			"e4 e5", "123 0", ""},
+		{"annotated moves don't end the game",
+			"1. e4 e5 2. Nf3!? Nc6 3. Bb5 1-0",
+			"e4 e5 Nf3 Nc6 Bb5", "", "",
+			"e4 e5", "", ""},
+		{"variations don't drop moves",
+			"1. e4 (1. d4 d5) 1... e5 2. Nf3 1-0",
+			"e4 e5 Nf3", "", "",
+			"e4 Nf3", "", ""},
+		{"free-text comments don't drop moves",
+			"1. e4 { best by test } 1... e5 2. Nf3 1-0",
+			"e4 e5 Nf3", "", "",
+			"e4 Nf3", "", ""},
+		{"unspaced move numbers are read",
+			"1.e4 e5 2.Nf3 1-0",
+			"e4 e5 Nf3", "", "",
+			"", "", ""},
+		{"evals with a depth suffix are kept",
+			"1. e4 { [%eval 0.3,20] [%clk 0:03:00] } 1... e5 { [%eval 0.25] [%clk 0:03:00] } 1-0",
+			"e4 e5", "180 180", "0.3 0.25",
+			"e4", "", ""},
+	};
+	for (auto& d: divergences) {
+		parseMoves(d.movetext, parsed);
+		check(parsed.mvs == d.mvs && parsed.clk == d.clk && parsed.eval == d.eval,
+			string(d.why) + ": got \"" + parsed.mvs + "\" \"" + parsed.clk + "\" \"" + parsed.eval + "\"", d.movetext);
+		auto [mvs, clk, eval, result] = reference::parseMoves(d.movetext);
+		check(mvs == d.oldMvs && clk == d.oldClk && eval == d.oldEval,
+			string(d.why) + ": the old parser gave \"" + mvs + "\" \"" + clk + "\" \"" + eval + "\"", d.movetext);
+	}
+
+	// a movetext without moves is rejected rather than parsed as an empty game
+	bool threw = false;
+	try {
+		parseMoves("1-0", parsed);
+	} catch (runtime_error&) {
+		threw = true;
+	}
+	check(threw, "no moves: not rejected", "1-0");
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("parseMoves matches the reference parser\n");
+	return 0;
+}
@@ -0,0 +1,182 @@
+// Writes numbered rows through PartitionWriter and reads the files back, checking
+// that every partition gets its rows once and in order, that files roll over at
+// max_file_rows, also when budget pressure flushes partitions early, and that no more
+// than max_open_files files are open at once, give or take one per shard.
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <parquet/arrow/reader.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "executor.h"
+#include "memoryBudget.h"
+#include "partitionWriter.h"
+#include "partitioner.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static const int N_BATCHES = 40;
+static const int64_t BATCH_ROWS = 333;
+// partition p holds the values from p * PARTITION_BASE on
+static const int64_t PARTITION_BASE = 1000000;
+
+struct Case {
+	string name;
+	int64_t maxFileRows;
+	int64_t maxFileBytes;
+	size_t nShards;
+	size_t maxOpenFiles;
+	size_t budgetBytes;
+};
+
+// the rows of each file of a partition, by file number
+struct Partition {
+	vector<int64_t> fileRows;
+	vector<int64_t> values;
+};
+
+static shared_ptr<arrow::RecordBatch> makeRows(shared_ptr<arrow::Schema> schema, int64_t first, int64_t n) {
+	arrow::Int64Builder builder;
+	for (int64_t i = 0; i < n; i++) {
+		if (!builder.Append(first + i).ok()) throw runtime_error("Error building rows");
+	}
+	return arrow::RecordBatch::Make(schema, n, {*builder.Finish()});
+}
+
+// the files under dir this process has open, where that can be told
+static size_t openFiles(const fs::path& dir) {
+	size_t n = 0;
+#ifdef __linux__
+	for (auto& fd: fs::directory_iterator("/proc/self/fd")) {
+		error_code error;
+		fs::path target = fs::read_symlink(fd.path(), error);
+		if (!error && target.string().rfind(dir.string(), 0) == 0) {
+			n++;
+		}
+	}
+#endif
+	return n;
+}
+
+static Partition readPartition(const fs::path& dir) {
+	Partition partition;
+	for (int n = 0; fs::exists(dir / ("part-" + to_string(n) + ".parquet")); n++) {
+		auto file = *arrow::io::ReadableFile::Open((dir / ("part-" + to_string(n) + ".parquet")).string());
+		auto reader = parquet::arrow::OpenFile(file, arrow::default_memory_pool());
+		if (!reader.ok()) throw runtime_error("Error opening " + dir.string() + ": " + reader.status().ToString());
+		auto read = (*reader)->ReadTable();
+		if (!read.ok()) throw runtime_error("Error reading " + dir.string() + ": " + read.status().ToString());
+		auto table = *read;
+		partition.fileRows.push_back(table->num_rows());
+		for (auto& chunk: table->column(0)->chunks()) {
+			auto values = static_pointer_cast<arrow::Int64Array>(chunk);
+			for (int64_t i = 0; i < values->length(); i++) {
+				partition.values.push_back(values->Value(i));
+			}
+		}
+	}
+	return partition;
+}
+
+static void run(const Case& c) {
+	fs::path dir = fs::temp_directory_path() / ("partitionWriterTest." + to_string(getpid()));
+	fs::remove_all(dir);
+	auto schema = arrow::schema({arrow::field("value", arrow::int64())});
+	auto partitioner = make_shared<Partitioner>(vector<string>{"welo"}, vector<int>{1000, 1500, 2000});
+	const size_t nPartitions = 4;
+	{
+		auto executor = make_unique<Executor>(4);
+		shared_ptr<MemoryBudget> budget;
+		if (c.budgetBytes > 0) {
+			budget = make_shared<MemoryBudget>(c.budgetBytes);
+		}
+		PartitionWriter writer(executor.get(), dir.string(), partitioner, 500, c.maxFileRows, c.maxFileBytes, schema, 4, budget, c.nShards, c.maxOpenFiles);
+		size_t mostOpen = 0;
+		for (int b = 0; b < N_BATCHES; b++) {
+			vector<PartitionRows> rows;
+			for (size_t p = 0; p < nPartitions; p++) {
+				rows.push_back({p, makeRows(schema, p * PARTITION_BASE + b * BATCH_ROWS, BATCH_ROWS)});
+			}
+			writer.queueBatch(rows, nullptr);
+			mostOpen = max(mostOpen, openFiles(dir));
+			if (budget && b % 5 == 4) {
+				writer.requestFlush();
+			}
+		}
+		writer.close();
+		// drain tasks scheduled for work close already did still refer to the writer
+		executor.reset();
+		if (c.maxOpenFiles > 0) {
+			// a shard with no file open opens one regardless of the others
+			size_t limit = c.maxOpenFiles + min(c.nShards, c.maxOpenFiles) - 1;
+			check(mostOpen <= limit, c.name + ": " + to_string(mostOpen) + " files open at once");
+		}
+		check(openFiles(dir) == 0, c.name + ": files left open");
+		check(!budget || budget->used() == 0, c.name + ": " + (budget ? to_string(budget->used()) : "") + " bytes still charged");
+	}
+
+	for (size_t p = 0; p < nPartitions; p++) {
+		string what = c.name + ", " + partitioner->path(p);
+		Partition partition = readPartition(dir / partitioner->path(p));
+		bool inOrder = static_cast<int64_t>(partition.values.size()) == N_BATCHES * BATCH_ROWS;
+		for (size_t i = 0; inOrder && i < partition.values.size(); i++) {
+			inOrder = partition.values[i] == static_cast<int64_t>(p * PARTITION_BASE + i);
+		}
+		check(inOrder, what + ": " + to_string(partition.values.size()) + " rows, not all in order");
+		for (size_t n = 0; n < partition.fileRows.size(); n++) {
+			int64_t rows = partition.fileRows[n];
+			check(rows > 0, what + ": file " + to_string(n) + " is empty");
+			check(c.maxFileRows == 0 || rows <= c.maxFileRows, what + ": file " + to_string(n) + " has " + to_string(rows) + " rows");
+			// without early flushes, only the last file stops short of the limit
+			if (c.maxFileRows > 0 && c.budgetBytes == 0 && c.maxOpenFiles == 0 && n + 1 < partition.fileRows.size()) {
+				check(rows == c.maxFileRows, what + ": file " + to_string(n) + " rolled over at " + to_string(rows) + " rows");
+			}
+		}
+		if (c.maxFileRows == 0 && c.maxFileBytes == 0 && c.budgetBytes == 0 && c.maxOpenFiles == 0) {
+			check(partition.fileRows.size() == 1, what + ": " + to_string(partition.fileRows.size()) + " files without limits");
+		}
+		if (c.maxFileBytes > 0) {
+			check(partition.fileRows.size() > 1, what + ": no roll over by bytes");
+		}
+	}
+	fs::remove_all(dir);
+}
+
+int main() {
+	vector<Case> cases = {
+		{"no limits", 0, 0, 1, 0, 0},
+		{"1000 rows per file", 1000, 0, 1, 0, 0},
+		{"1000 rows per file, 3 shards", 1000, 0, 3, 0, 0},
+		{"100 rows per file", 100, 0, 2, 0, 0},
+		{"10000 bytes per file", 0, 10000, 2, 0, 0},
+		{"1000 rows per file under pressure", 1000, 0, 2, 0, 64 << 10},
+		{"1 open file", 0, 0, 1, 1, 0},
+		{"2 open files, 1000 rows per file", 1000, 0, 1, 2, 0},
+		{"2 open files, 2 shards", 0, 0, 2, 2, 0},
+		{"3 open files, 4 shards, 1000 rows per file", 1000, 0, 4, 3, 0},
+	};
+	for (auto& c: cases) {
+		run(c);
+	}
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("partition writer checks passed\n");
+	return 0;
+}
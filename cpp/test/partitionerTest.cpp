@@ -0,0 +1,113 @@
+// Checks the Hive directories Partitioner puts games in: the Elo bucket and speed
+// labels, months from UTCDate or Date, escaped tag values and the default partition.
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "partitioner.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+// the partition of a game with the given ratings, time control and further header
+// lines, as the block tasks find it
+static size_t partitionOf(Partitioner& partitioner, int welo, int belo, const string& timeControl, const string& headers = "") {
+	string game = "[Event \"Rated game\"]\n[WhiteElo \"" + to_string(welo) + "\"]\n[BlackElo \"" + to_string(belo) + "\"]\n";
+	game += "[TimeControl \"" + timeControl + "\"]\n" + headers + "\n1. e4 e5 1-0\n";
+	PgnProcessor processor(0, 100000, 1000, nullptr, partitioner.getTags());
+	vector<size_t> slots;
+	for (size_t i = 0; i < partitioner.getTags().size(); i++) {
+		slots.push_back(i);
+	}
+	size_t lineStart = 0;
+	while (lineStart < game.size()) {
+		size_t lineEnd = game.find('\n', lineStart);
+		if (processor.processLine(string_view(game).substr(lineStart, lineEnd - lineStart)) == LineStatus::COMPLETE) {
+			// the tag values are views into game
+			return partitioner.partitionOf(processor, slots);
+		}
+		lineStart = lineEnd + 1;
+	}
+	throw runtime_error("incomplete game");
+}
+
+static void checkPath(Partitioner& partitioner, const string& expected, int welo, int belo, const string& timeControl, const string& headers = "") {
+	string path = partitioner.path(partitionOf(partitioner, welo, belo, timeControl, headers));
+	check(path == expected, "expected " + expected + ", got " + path);
+}
+
+static void checkThrows(vector<string> keys, vector<int> eloEdges, const string& what) {
+	bool threw = false;
+	try {
+		Partitioner partitioner(keys, eloEdges);
+	} catch (runtime_error&) {
+		threw = true;
+	}
+	check(threw, what + " accepted");
+}
+
+int main() {
+	vector<int> edges = {1000, 1500, 2000};
+
+	// buckets are named after their upper edge, the last one after the last edge
+	Partitioner elo({"welo", "belo", "tc"}, edges);
+	checkPath(elo, "welo_bucket=1000/belo_bucket=1500/tc=blitz", 999, 1000, "180+2");
+	checkPath(elo, "welo_bucket=2000/belo_bucket=2000+/tc=blitz", 1500, 2100, "180+2");
+	checkPath(elo, "welo_bucket=2000+/belo_bucket=2000+/tc=blitz", 2000, 3000, "180+2");
+	// speeds by time + 40 * increment
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=ultrabullet", 1200, 1200, "15+0");
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=bullet", 1200, 1200, "60+1");
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=bullet", 1200, 1200, "120+1");
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=blitz", 1200, 1200, "180+0");
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=rapid", 1200, 1200, "600+0");
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=rapid", 1200, 1200, "900+10");
+	checkPath(elo, "welo_bucket=1500/belo_bucket=1500/tc=classical", 1200, 1200, "1800+0");
+	// the fixed partitions are numbered up front, so every number has a path
+	for (size_t p = 0; p < 4 * 4 * 5; p++) {
+		string path = elo.path(p);
+		check(path.find("welo_bucket=") == 0 && path.find("/belo_bucket=") != string::npos && path.find("/tc=") != string::npos, "partition " + to_string(p) + " is " + path);
+	}
+
+	// months from UTCDate, Date without one, and the default partition without either
+	Partitioner month({"month", "welo"}, edges);
+	checkPath(month, "month=2024-01/welo_bucket=1500", 1200, 1200, "180+0", "[UTCDate \"2024.01.31\"]\n[Date \"2023.12.31\"]\n");
+	checkPath(month, "month=2023-12/welo_bucket=1500", 1200, 1200, "180+0", "[Date \"2023.12.31\"]\n");
+	checkPath(month, "month=2023-12/welo_bucket=1500", 1200, 1200, "180+0", "[UTCDate \"????.??.??\"]\n[Date \"2023.12.??\"]\n");
+	checkPath(month, "month=__HIVE_DEFAULT_PARTITION__/welo_bucket=1500", 1200, 1200, "180+0", "[UTCDate \"????.??.??\"]\n");
+	checkPath(month, "month=__HIVE_DEFAULT_PARTITION__/welo_bucket=2000", 1600, 1200, "180+0");
+	size_t a = partitionOf(month, 1200, 1200, "180+0", "[UTCDate \"2024.01.31\"]\n");
+	size_t b = partitionOf(month, 1300, 1200, "180+0", "[UTCDate \"2024.01.02\"]\n");
+	size_t c = partitionOf(month, 1600, 1200, "180+0", "[UTCDate \"2024.01.02\"]\n");
+	check(a == b && a != c, "partitions of the same month and bucket differ");
+
+	// tag values are escaped the way Hive does, and a missing or empty tag is the default
+	Partitioner tag({"Opening"}, {});
+	checkPath(tag, "Opening=Sicilian Defense%3A Najdorf Variation", 1200, 1200, "180+0", "[Opening \"Sicilian Defense: Najdorf Variation\"]\n");
+	checkPath(tag, "Opening=a%2Fb%3Dc%23d%25e%3Ff%2Ag%5Bh%5Di%5Ej%7Bk%5Cl%27", 1200, 1200, "180+0", "[Opening \"a/b=c#d%e?f*g[h]i^j{k\\l'\"]\n");
+	checkPath(tag, "Opening=tab%09", 1200, 1200, "180+0", "[Opening \"tab\t\"]\n");
+	checkPath(tag, "Opening=__HIVE_DEFAULT_PARTITION__", 1200, 1200, "180+0", "[Opening \"\"]\n");
+	checkPath(tag, "Opening=__HIVE_DEFAULT_PARTITION__", 1200, 1200, "180+0");
+	check(partitionOf(tag, 1200, 1200, "180+0", "[Opening \"x\"]\n") != partitionOf(tag, 1200, 1200, "180+0", "[Opening \"x \"]\n"), "values that differ by a space share a partition");
+
+	checkThrows({}, edges, "no keys");
+	checkThrows({"tc", "tc"}, edges, "a repeated key");
+	checkThrows({"welo"}, {}, "welo without edges");
+	checkThrows({"a=b"}, edges, "a key with '='");
+	checkThrows({"a/b"}, edges, "a key with '/'");
+	checkThrows({""}, edges, "an empty key");
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("partitioner checks passed\n");
+	return 0;
+}
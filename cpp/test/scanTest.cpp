@@ -0,0 +1,78 @@
+// Checks findNewlines and findGameStarts against a byte by byte scan on random buffers
+// full of newlines, brackets and partial [Event tags, over random ranges. Each range
+// gets a buffer that ends 6 bytes past it, as the scanners promise to read no further.
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "scan.h"
+
+using namespace std;
+
+static int nFailed = 0;
+
+static void check(bool ok, const string& what) {
+	if (!ok) {
+		nFailed++;
+		printf("FAILED: %s\n", what.c_str());
+	}
+}
+
+static vector<uint32_t> newlinesOf(const char* buf, size_t begin, size_t end) {
+	vector<uint32_t> out;
+	for (size_t p = begin; p < end; p++) {
+		if (buf[p] == '\n') out.push_back(p);
+	}
+	return out;
+}
+
+static vector<size_t> gameStartsOf(const char* buf, size_t begin, size_t end) {
+	vector<size_t> out;
+	for (size_t p = begin; p < end; p++) {
+		if ((p == 0 || buf[p-1] == '\n') && memcmp(buf + p, "[Event ", 7) == 0) out.push_back(p);
+	}
+	return out;
+}
+
+int main() {
+	mt19937 rng(12345);
+	const string pieces[] = {"\n", "[", "[Event ", "[Event", "\n[Event \"", "\n[Eve", "[Site \"", "e4 ", "\n\n", "Event ", "x"};
+	const size_t nPieces = sizeof(pieces) / sizeof(pieces[0]);
+	int nStarts = 0;
+	for (int round = 0; round < 3000; round++) {
+		string text;
+		size_t size = rng() % (round < 1000 ? 100 : 2000);
+		while (text.size() < size) {
+			text += pieces[rng() % nPieces];
+		}
+		size_t end = rng() % (text.size() + 1);
+		size_t begin = rng() % 4 == 0 ? 0 : rng() % (end + 1);
+		// the scanners may read up to end + 6
+		vector<char> buf(text.begin(), text.begin() + end);
+		for (int i = 0; i < 6; i++) {
+			buf.push_back(end + i < text.size() ? text[end + i] : pieces[rng() % nPieces][0]);
+		}
+		string what = "round " + to_string(round) + ", [" + to_string(begin) + ", " + to_string(end) + ")";
+
+		vector<uint32_t> newlines;
+		findNewlines(buf.data(), begin, end, newlines);
+		check(newlines == newlinesOf(buf.data(), begin, end), what + ": newlines differ");
+
+		// the scanners append to what is there already
+		vector<size_t> starts = {12345};
+		findGameStarts(buf.data(), begin, end, starts);
+		vector<size_t> expected = gameStartsOf(buf.data(), begin, end);
+		expected.insert(expected.begin(), 12345);
+		check(starts == expected, what + ": game starts differ");
+		nStarts += expected.size() - 1;
+	}
+	check(nStarts > 1000, "only " + to_string(nStarts) + " game starts in the random buffers");
+
+	if (nFailed > 0) {
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("scan checks passed\n");
+	return 0;
+}
@@ -65,7 +65,6 @@ extension = Extension(
         "parquet",  # Parquet dependency
         "curl",  # Curl dependency
         "zstd",  # Zstd dependency
-        "re2",  # RE2 dependency
     ],
     library_dirs=[
         system_lib_dir,  # For system libraries
@@ -1,4 +1,23 @@
-from .pgnzstparser import PyParserPool
+import re
+
+from .pgnzstparser import PyParserPool, reframe as _reframe
+
+MOVE_FORMATS = {"san": 1, "codes": 2, "uci": 4, "hashes": 8}
+
+_SIZE_UNITS = {"": 1, "b": 1, "kb": 10**3, "mb": 10**6, "gb": 10**9, "tb": 10**12,
+               "kib": 2**10, "mib": 2**20, "gib": 2**30, "tib": 2**40}
+
+
+def _parse_size(size):
+    """Bytes in an int or a string like "512MB" or "16GiB"; None is 0 (unlimited)."""
+    if size is None:
+        return 0
+    if isinstance(size, int):
+        return size
+    m = re.fullmatch(r"\s*(\d+(?:\.\d+)?)\s*([a-zA-Z]*)\s*", size)
+    if m is None or m.group(2).lower() not in _SIZE_UNITS:
+        raise ValueError(f"invalid size: {size!r}")
+    return int(float(m.group(1)) * _SIZE_UNITS[m.group(2).lower()])
 
 
 class ParserPool:
@@ -14,22 +33,126 @@ class ParserPool:
         chunkSize=1024,
         printFreq=1,
         outdir="pzp-output",
+        blockSize=1024*1024,
+        queueDepth=4,
+        moveFormats=("san",),
+        hashPlies=None,
+        numericAnnotations=False,
+        filter=None,
+        extraTags=(),
+        dedup=False,
+        dedupFile=None,
+        gamesQueueSize=64,
+        batchQueueSize=16,
+        maxMemory=None,
+        nThreads=None,
+        nWriters=None,
+        stream=False,
+        partitionBy=("welo", "belo"),
+        maxFileRows=None,
+        maxFileSize=None,
+        maxOpenFiles=None,
     ):
         """
         Initialize a parser pool with the given parameters.
 
         Args:
             nSimultaneous: Number of files to process simultaneously.
-            nReadersPerFile: Number of readers per file.
-            nParsersPerFile: Number of parsers per file.
+            nReadersPerFile: Number of ranges each file is split into for
+                reading.
+            nParsersPerFile: Ignored, kept for compatibility. Games are parsed
+                by tasks on the pool's shared workers, see nThreads.
             minSec: Minimum time control in seconds.
             maxSec: Maximum time control in seconds.
             maxInc: Maximum increment in seconds.
-            elo_edges: Elo rating buckets.
-            chunkSize: Size of chunks to process.
+            elo_edges: Edges of the Elo buckets of the welo and belo partition
+                keys. Each bucket is named after its upper edge, and ratings
+                from the last edge up go to "<last edge>+".
+            chunkSize: Number of parsed games each parsing task buffers, split
+                by partition. When it is reached, the largest partitions are
+                handed to the writer, so larger values mean fewer, larger
+                Arrow batches.
             printFreq: Frequency of progress printing.
             printOffset: Offset for progress printing.
-            outdir: Output directory for parsed files.
+            outdir: Root directory of the Hive-style dataset the games are
+                written to, see partitionBy.
+            blockSize: Size in bytes of each compressed block read from disk.
+            queueDepth: Number of compressed blocks each reader keeps in flight
+                while decompressing; 0 reads synchronously.
+            moveFormats: Move columns to write, any of "san" (space-separated SAN
+                in "moves"), "codes" (list<uint16> "move_codes", from | to<<6 |
+                promotion<<12 with a1=0 and promotion 1-4 for N, B, R, Q),
+                "uci" (space-separated UCI in "uci") and "hashes" (list<uint64>
+                "hashes", the Zobrist hash of the position after each ply).
+                "codes", "uci" and "hashes" replay every game and drop games
+                containing illegal moves.
+            hashPlies: Only hash the first hashPlies plies of each game; None
+                hashes all of them.
+            numericAnnotations: Write clk as list<int32> seconds and eval as
+                list<float> pawns, with mate scores in a separate list<int16>
+                "mate" column (null where eval holds a number, and vice versa),
+                instead of space-separated strings.
+            filter: Expression over PGN header tags that a game must satisfy to
+                be written, checked before its moves are parsed, e.g.
+                'Event contains "Rated" and abs(WhiteElo - BlackElo) <= 200'.
+                Supports == != < <= > >=, contains, in (...), not in (...), and,
+                or, not, parentheses, +, - and abs(). Comparisons are numeric when
+                both sides are integers and lexicographic otherwise; missing tags
+                compare as "". None keeps every game.
+            extraTags: Header tags to write as extra columns, e.g. ("Site",
+                "UTCDate", "UTCTime", "ECO", "Opening", "Result"). Columns are
+                named after the tag and hold strings, except that Date,
+                UTCDate and EventDate are date32, Time and UTCTime are
+                time32[ms], White/BlackRatingDiff are int16 and Site is written
+                as "gameId", the last path segment of the game URL. Missing or
+                unknown values are null.
+            dedup: Drop games that were already seen by this pool, identified
+                by their Site URL or, without one, by their full text.
+            dedupFile: Path of a file the seen games are loaded from, if it
+                exists, and saved to on join, to deduplicate across runs.
+                Implies dedup.
+            gamesQueueSize: Number of blocks of 100 games per file that may be
+                read but not yet parsed. Readers wait when it is reached,
+                which bounds how far they can run ahead.
+            batchQueueSize: Capacity, in chunks of chunkSize games, of the queue
+                in front of each writer shard, shared by all files.
+            maxMemory: Budget, in bytes or as a string like "16GiB", for the raw
+                games in flight, the rows waiting to be written and the row
+                groups Parquet buffers, across all simultaneous files. Readers
+                wait while it is spent, and the writer then writes out its
+                largest partitions, ending their row groups early, to make room.
+                The few buffers an open file keeps between row groups are not
+                counted; maxOpenFiles bounds them. None is unlimited.
+            nThreads: Number of worker threads that read, parse and write for
+                all files together. None uses one per hardware thread.
+            nWriters: Number of shards the partitions are split among. Each
+                shard's partitions are encoded and compressed by one task at a
+                time, so this bounds how many partitions are written
+                concurrently. None uses one per worker thread.
+            stream: Hand the games to the reader returned by stream() instead
+                of writing Parquet files. outdir, elo_edges, nWriters,
+                partitionBy, maxFileRows, maxFileSize and maxOpenFiles are then
+                ignored, and batchQueueSize is the number of batches that may
+                wait for the reader.
+            partitionBy: Partition keys, one directory level each, e.g.
+                outdir/welo_bucket=1600/belo_bucket=1800/part-0.parquet for
+                ("welo", "belo"), the players' Elo buckets. "tc" is the lichess
+                speed (ultrabullet, bullet, blitz, rapid or classical), "month"
+                is the yyyy-mm of UTCDate, or of Date without one, and any other
+                key is a header tag, e.g. "Event". Games without the month or
+                tag go to __HIVE_DEFAULT_PARTITION__.
+            maxFileRows: Rows after which a partition's file is closed and a new
+                one started. None is unlimited.
+            maxFileSize: Size, in bytes or as a string like "256MB", after which
+                a partition's file is closed and a new one started. Files are
+                checked between row groups, which hold at most 128MiB of Arrow
+                data, so they can go past it by up to one compressed row
+                group. None is unlimited.
+            maxOpenFiles: Number of Parquet files kept open at once, split
+                evenly among the writer shards (whose number it caps). When a
+                partition needs a file and none is left, the least recently
+                written file is finished, and that partition starts a new file
+                if it gets more rows. None is unlimited.
         """
         assert nSimultaneous >= 1
         assert nReadersPerFile >= 1
@@ -39,19 +162,52 @@ class ParserPool:
         assert maxInc >= 0
         assert chunkSize >= 1
         assert printFreq >= 1
-        assert outdir is not None
+        assert stream or outdir is not None
+        assert blockSize >= 1
+        assert queueDepth >= 0
+        assert gamesQueueSize >= 1 and batchQueueSize >= 1
+        assert nThreads is None or nThreads >= 1
+        assert nWriters is None or nWriters >= 1
+        assert len(set(extraTags)) == len(extraTags)
+        assert len(partitionBy) > 0 and len(set(partitionBy)) == len(partitionBy)
+        assert maxFileRows is None or maxFileRows >= 1
+        assert maxOpenFiles is None or maxOpenFiles >= 1
+        maxFileSize = _parse_size(maxFileSize)
+        assert maxFileSize >= 0
+        assert hashPlies is None or hashPlies >= 0
+        maxMemory = _parse_size(maxMemory)
+        assert maxMemory >= 0
+        assert len(moveFormats) > 0 and all(fmt in MOVE_FORMATS for fmt in moveFormats)
 
         self._pool = PyParserPool(
             nReadersPerFile,
-            nParsersPerFile,
+            nThreads or 0,
             minSec,
             maxSec,
             maxInc,
-            outdir,
+            outdir or "",
             elo_edges,
             chunkSize,
             printFreq,
             nSimultaneous,
+            blockSize,
+            queueDepth,
+            sum(MOVE_FORMATS[fmt] for fmt in set(moveFormats)),
+            2**64-1 if hashPlies is None else hashPlies,
+            numericAnnotations,
+            filter or "",
+            list(extraTags),
+            dedup or dedupFile is not None,
+            dedupFile or "",
+            gamesQueueSize,
+            batchQueueSize,
+            maxMemory,
+            nWriters or 0,
+            stream,
+            list(partitionBy),
+            maxFileRows or 0,
+            maxFileSize,
+            maxOpenFiles or 0,
         )
 
     def enqueue(self, file_path: str, name: str):
@@ -60,12 +216,43 @@ class ParserPool:
     def join(self):
         self._pool.join()
 
+    def stream(self):
+        """
+        Stop accepting files and return a pyarrow.RecordBatchReader over the games
+        of the files enqueued so far, for a pool created with stream=True.
+
+        The reader ends once all of them are parsed. Batches are handed over
+        without copying, and parsing runs on the pool's threads while the GIL is
+        released, so reading keeps up with parsing. Parsing waits while
+        batchQueueSize batches are unread. Read the stream before calling join(),
+        which otherwise waits for it; if stream() is never called, join() drops
+        the games.
+        """
+        return self._pool.stream()
+
     def get_completed(self):
         names = self._pool.get_completed()
         counts = self._pool.get_ngames()
         return [(name.decode('utf-8'), ngames) for name, ngames in zip(names, counts)]
 
+    def get_duplicates(self):
+        """Number of duplicate games dropped from each completed file, in the order of get_completed."""
+        names = self._pool.get_completed()
+        counts = self._pool.get_nduplicates()
+        return [(name.decode('utf-8'), ndup) for name, ndup in zip(names, counts)]
+
     def get_info(self):
         info = self._pool.get_info()
         return [line.decode('utf-8') for line in info]
-        
+
+
+def reframe(src: str, dst: str, frameSize=8*1024*1024, level=3):
+    """
+    Re-compress a .pgn.zst archive so that it can be split across any number of readers.
+
+    The output consists of independent zstd frames of roughly frameSize decompressed
+    bytes, each starting at a game boundary, followed by a seek table in the zstd
+    seekable format. Returns the number of frames written.
+    """
+    assert frameSize >= 1
+    return _reframe(src, dst, frameSize, level)